@@ -0,0 +1,148 @@
+//
+// Benchmark of allocation policies on a wide price range book. Orders are
+// added & deleted at random prices so that every operation jumps through
+// price_nodes_, and dTLB load misses are counted with perf events.
+//
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <chrono>
+#include <random>
+using namespace std;
+
+#include "comm/util/strutil.h"
+#include "comm/kit/cmdline_parser.h"
+
+#include "orderbook.h"
+
+void Help(int argc, char* argv[])
+{
+    fprintf(stderr, "usage:%s -h [-r range] [-n orders] [-o ops] [-p policy] [-b] [-v]\n"
+                    "where:\n"
+                    "-r range : price range in ticks of each side, default 1000000\n"
+                    "-n orders: resting orders before measuring, default 100000\n"
+                    "-o ops   : measured add & delete operations, default 1000000\n"
+                    "-p policy: none, thp, explicit or all, default all\n"
+                    "-b       : bind memory to numa node of current thread\n"
+                    "-v       : trace every book operation, off to keep it out of timing\n",
+                    argv[0]);
+    exit(0);
+}
+
+/*
+ * open dTLB load miss counter of current thread, return -1 if unsupported
+ */
+int OpenTlbMissCounter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.size           = sizeof(attr);
+    attr.config         = PERF_COUNT_HW_CACHE_DTLB
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void RunBench(const char* name, const AllocPolicy& policy, int range, int orders, int ops)
+{
+    OrderBook book(1, OrderIdLessInteger, range, range, policy);
+    mt19937 rng(20210602);
+    uniform_int_distribution<int> offset(1, range - 1);
+
+    //
+    // asks rest above mid and bids below, so nothing matches
+    //
+    const int mid = range + 1;
+    vector<OrderNode> resting(orders);
+    for(int i = 0; i < orders; i++)
+    {
+        OrderType type = (i % 2 == 0 ? OrderType_Ask : OrderType_Bid);
+        int32_t price  = (type == OrderType_Ask ? mid + offset(rng) : mid - offset(rng));
+        resting[i] = OrderNode(price, CommUtil::ToStr(i), 1, type);
+        book.AddOrder(resting[i]);
+    }
+
+    int fd = OpenTlbMissCounter();
+    if(fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    auto start = chrono::steady_clock::now();
+
+    // replace a random resting order with one at another random price
+    int next_id = orders;
+    for(int i = 0; i < ops; i++)
+    {
+        OrderNode& order_node = resting[rng() % orders];
+        book.DeleteOrder(order_node);
+        order_node.id_    = CommUtil::ToStr(next_id++);
+        order_node.price_ = (order_node.type_ == OrderType_Ask ? mid + offset(rng) : mid - offset(rng));
+        book.AddOrder(order_node);
+    }
+
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    long long misses = -1;
+    if(fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if(read(fd, &misses, sizeof(misses)) != sizeof(misses)) { misses = -1; }
+        close(fd);
+    }
+
+    if(misses >= 0)
+    {
+        fprintf(stderr, "%-9s %8.1f ns/op  %8.3f dTLB misses/op\n", name, (double)elapsed / ops, (double)misses / ops);
+    }
+    else
+    {
+        fprintf(stderr, "%-9s %8.1f ns/op  dTLB misses n/a\n", name, (double)elapsed / ops);
+    }
+
+    book.Clear();
+}
+
+int main(int argc, char* argv[])
+{
+    CommUtil::CmdLineParser parser("hr:n:o:p:bv");
+    parser.Parse(argc, argv);
+    if(parser.Has('h'))
+    {
+        Help(argc, argv);
+    }
+
+    int range  = (parser.Has('r') ? parser.GetInt('r') : 1000000);
+    int orders = (parser.Has('n') ? parser.GetInt('n') : 100000);
+    int ops    = (parser.Has('o') ? parser.GetInt('o') : 1000000);
+    string which = (parser.Has('p') ? parser.Get('p') : "all");
+    bool numa_bind = parser.Has('b');
+    orderbook_trace = parser.Has('v');
+
+    const struct
+    {
+        const char*  name_;
+        HugePageMode mode_;
+    } policies[] = {
+        {"none",     HugePage_None},
+        {"thp",      HugePage_Transparent},
+        {"explicit", HugePage_Explicit},
+    };
+
+    for(auto& policy : policies)
+    {
+        if(which == "all" || which == policy.name_)
+        {
+            RunBench(policy.name_, AllocPolicy(policy.mode_, numa_bind), range, orders, ops);
+        }
+    }
+
+    return 0;
+}
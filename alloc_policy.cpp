@@ -0,0 +1,212 @@
+//
+// huge page & numa aware allocation, see alloc_policy.h
+//
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "comm/util/logutil.h"
+
+#include "alloc_policy.h"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+static const size_t kHugePageSize = 2 << 20;
+
+//
+// each region starts with a header, one cache line to keep data aligned.
+// map_size_ is 0 if region comes from heap
+//
+typedef struct RegionHeader
+{
+    size_t map_size_;
+    char   padding_[64 - sizeof(size_t)];
+} RegionHeader;
+
+static size_t RoundUp(size_t size, size_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+/*
+ * prefer numa node for region, must be called before first touch
+ */
+static void BindNumaNode(void* addr, size_t size, int node)
+{
+    unsigned long mask[16] = {0};
+    if(node < 0 || node >= (int)(sizeof(mask) * 8))
+    {
+        return;
+    }
+
+    mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+    if(syscall(SYS_mbind, addr, size, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0)
+    {
+        LOG_DEBUG("mbind size:%zu to numa node:%d failed, errno:%d", size, node, errno);
+    }
+}
+
+/*
+ * map region aligned to huge page, return NULL on failure
+ */
+static void* MapHugeRegion(size_t map_size, HugePageMode mode)
+{
+#ifdef MAP_HUGETLB
+    if(mode == HugePage_Explicit)
+    {
+        void* addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(addr != MAP_FAILED)
+        {
+            return addr;
+        }
+        LOG_DEBUG("no explicit huge page for size:%zu, errno:%d, try transparent huge page", map_size, errno);
+    }
+#endif
+
+    // over-map by one huge page and trim, so that region is 2M aligned
+    char* raw = (char*)mmap(NULL, map_size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    char*  addr = (char*)RoundUp((size_t)raw, kHugePageSize);
+    size_t head = addr - raw;
+    if(head > 0) { munmap(raw, head); }
+    munmap(addr + map_size, kHugePageSize - head);
+
+#ifdef MADV_HUGEPAGE
+    if(madvise(addr, map_size, MADV_HUGEPAGE) != 0)
+    {
+        LOG_DEBUG("madvise huge page for size:%zu failed, errno:%d", map_size, errno);
+    }
+#endif
+
+    return addr;
+}
+
+void* PolicyAlloc(size_t size, const AllocPolicy &policy)
+{
+    size_t total = size + sizeof(RegionHeader);
+    RegionHeader* header = NULL;
+
+    if(policy.huge_page_ != HugePage_None && total >= policy.min_huge_size_)
+    {
+        size_t map_size = RoundUp(total, kHugePageSize);
+        header = (RegionHeader*)MapHugeRegion(map_size, policy.huge_page_);
+        if(header != NULL)
+        {
+            if(policy.numa_bind_)
+            {
+                BindNumaNode(header, map_size, policy.numa_node_ == -1 ? GetCurrentNumaNode() : policy.numa_node_);
+            }
+            header->map_size_ = map_size;
+        }
+    }
+
+    if(header == NULL)
+    {
+        header = (RegionHeader*)calloc(1, total);
+        if(header == NULL)
+        {
+            throw std::bad_alloc();
+        }
+        header->map_size_ = 0;
+    }
+
+    return header + 1;
+}
+
+void PolicyFree(void* ptr)
+{
+    if(ptr == NULL) { return; }
+
+    RegionHeader* header = (RegionHeader*)ptr - 1;
+    if(header->map_size_ == 0)
+    {
+        free(header);
+    }
+    else
+    {
+        munmap(header, header->map_size_);
+    }
+}
+
+int GetCurrentNumaNode()
+{
+    unsigned cpu = 0, node = 0;
+    if(syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+    {
+        return 0;
+    }
+
+    return (int)node;
+}
+
+PolicyPool::PolicyPool(const AllocPolicy &policy) : policy_(policy)
+{
+
+}
+
+PolicyPool::~PolicyPool()
+{
+    for(auto chunk : chunks_)
+    {
+        PolicyFree(chunk);
+    }
+}
+
+void* PolicyPool::Alloc(size_t size)
+{
+    size = RoundUp(size < sizeof(void*) ? sizeof(void*) : size, sizeof(void*));
+    if(block_size_ == 0)
+    {
+        block_size_ = size;
+    }
+    if(size != block_size_)
+    {
+        return ::operator new(size);
+    }
+
+    if(free_list_ != NULL)
+    {
+        void* block = free_list_;
+        free_list_  = *(void**)block;
+        return block;
+    }
+
+    if((size_t)(chunk_end_ - chunk_cur_) < block_size_)
+    {
+        // keep chunk with its header within pool_chunk_size_, i.e. one huge page
+        size_t chunk_size = policy_.pool_chunk_size_ - sizeof(RegionHeader);
+        if(chunk_size < block_size_)
+        {
+            chunk_size = block_size_;
+        }
+        chunk_cur_ = (char*)PolicyAlloc(chunk_size, policy_);
+        chunk_end_ = chunk_cur_ + chunk_size;
+        chunks_.push_back(chunk_cur_);
+    }
+
+    void* block = chunk_cur_;
+    chunk_cur_ += block_size_;
+    return block;
+}
+
+void PolicyPool::Free(void* ptr, size_t size)
+{
+    size = RoundUp(size < sizeof(void*) ? sizeof(void*) : size, sizeof(void*));
+    if(size != block_size_)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    *(void**)ptr = free_list_;
+    free_list_   = ptr;
+}
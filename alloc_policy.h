@@ -0,0 +1,107 @@
+//
+// Allocation policy for price node arrays and order storage of Depth. Large
+// regions can be backed by transparent or explicit huge pages and bound to
+// a NUMA node, falling back to plain pages if the system can't provide them.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+using namespace std;
+
+enum HugePageMode
+{
+    HugePage_None        = 0,   // plain heap allocation
+    HugePage_Transparent = 1,   // 2M aligned mmap with madvise(MADV_HUGEPAGE)
+    HugePage_Explicit    = 2,   // mmap with MAP_HUGETLB, falls back to transparent
+};
+
+typedef struct AllocPolicy
+{
+    HugePageMode huge_page_   = HugePage_None;
+    bool    numa_bind_        = false;  // bind regions to numa_node_
+    int     numa_node_        = -1;     // -1 for node of the allocating thread
+    size_t  min_huge_size_    = 1 << 20;// smaller regions always come from heap
+    size_t  pool_chunk_size_  = 2 << 20;// chunk size of PolicyPool
+
+    AllocPolicy() {}
+    AllocPolicy(HugePageMode huge_page, bool numa_bind) :
+        huge_page_(huge_page), numa_bind_(numa_bind)
+    {}
+} AllocPolicy;
+
+/*
+ * allocate zeroed region of size bytes with policy, release by PolicyFree
+ */
+void* PolicyAlloc(size_t size, const AllocPolicy& policy);
+
+void PolicyFree(void* ptr);
+
+/*
+ * numa node of the calling thread, 0 if unknown
+ */
+int GetCurrentNumaNode();
+
+//
+// fixed size block pool carved from PolicyAlloc chunks. Block size is taken
+// from the first allocation, other sizes go to the general heap.
+//
+class PolicyPool
+{
+public:
+    PolicyPool(const AllocPolicy& policy = AllocPolicy());
+
+    ~PolicyPool();
+
+    void* Alloc(size_t size);
+
+    void Free(void* ptr, size_t size);
+
+private:
+    PolicyPool(const PolicyPool&);
+    PolicyPool& operator=(const PolicyPool&);
+
+    AllocPolicy   policy_;
+    size_t        block_size_ = 0;
+    char*         chunk_cur_  = NULL;   // next free byte in latest chunk
+    char*         chunk_end_  = NULL;
+    void*         free_list_  = NULL;
+    vector<void*> chunks_;
+};
+
+//
+// STL allocator on PolicyPool, single element allocations only are pooled
+//
+template <class T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    PoolAllocator(PolicyPool* pool) : pool_(pool) {}
+
+    template <class U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool_(other.pool_) {}
+
+    T* allocate(size_t n)
+    {
+        if(n == 1) { return static_cast<T*>(pool_->Alloc(sizeof(T))); }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        if(n == 1) { pool_->Free(ptr, sizeof(T)); return; }
+        ::operator delete(ptr);
+    }
+
+    template <class U>
+    bool operator==(const PoolAllocator<U>& other) const { return pool_ == other.pool_; }
+
+    template <class U>
+    bool operator!=(const PoolAllocator<U>& other) const { return pool_ != other.pool_; }
+
+    PolicyPool* pool_;
+};
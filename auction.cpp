@@ -0,0 +1,145 @@
+//
+// SIMD prefix sums & equilibrium price search for call auction
+//
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <stdlib.h>
+#include <algorithm>
+
+#include "auction.h"
+
+void AuctionPrefixSum(int64_t* values, int count)
+{
+    int i = 0;
+    int64_t sum = 0;
+
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i carry = zero;
+    for(; i + 4 <= count; i += 4)
+    {
+        // [a, b, c, d] -> [a, a+b, b+c, c+d] -> [a, a+b, a+b+c, a+b+c+d]
+        __m256i x = _mm256_loadu_si256((const __m256i*)(values + i));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x90), zero, 0x03));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x40), zero, 0x0F));
+        x = _mm256_add_epi64(x, carry);
+        carry = _mm256_permute4x64_epi64(x, 0xFF);
+        _mm256_storeu_si256((__m256i*)(values + i), x);
+    }
+    if(i > 0) { sum = values[i - 1]; }
+#elif defined(__SSE2__)
+    __m128i carry = _mm_setzero_si128();
+    for(; i + 2 <= count; i += 2)
+    {
+        // [a, b] -> [a, a+b]
+        __m128i x = _mm_loadu_si128((const __m128i*)(values + i));
+        x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi64(x, carry);
+        carry = _mm_shuffle_epi32(x, 0xEE);
+        _mm_storeu_si128((__m128i*)(values + i), x);
+    }
+    if(i > 0) { sum = values[i - 1]; }
+#endif
+
+    for(; i < count; i++)
+    {
+        sum += values[i];
+        values[i] = sum;
+    }
+}
+
+int SearchEquilibrium(int64_t* ask_sizes, int64_t* bid_sizes, int count, int preferred, int64_t& volume)
+{
+    AuctionPrefixSum(ask_sizes, count);
+    AuctionPrefixSum(bid_sizes, count);
+
+    int     best = -1;
+    int64_t best_imbalance = 0;
+    volume = 0;
+    for(int k = 0; k < count; k++)
+    {
+        // asks priced at or below and bids priced at or above this price
+        int64_t ask = ask_sizes[k];
+        int64_t bid = bid_sizes[count - 1 - k];
+        int64_t executable = (ask < bid ? ask : bid);
+        int64_t imbalance  = (ask < bid ? bid - ask : ask - bid);
+        if(executable == 0) { continue; }
+
+        if(executable > volume
+            || (executable == volume && imbalance < best_imbalance)
+            || (executable == volume && imbalance == best_imbalance && abs(k - preferred) < abs(best - preferred))
+        )
+        {
+            best = k;
+            volume = executable;
+            best_imbalance = imbalance;
+        }
+    }
+
+    return best;
+}
+
+int32_t SearchSparseEquilibrium(const vector<LevelSize>& ask_levels, const vector<LevelSize>& bid_levels,
+                                int32_t tick_price, int32_t preferred_price, int64_t& volume)
+{
+    int64_t bid_above = 0;  // bids priced above last visited price
+    for(auto& level : bid_levels) { bid_above += level.size_; }
+
+    int32_t best = 0;
+    int64_t best_imbalance = 0;
+    volume = 0;
+    auto evaluate = [&](int32_t price, int64_t ask, int64_t bid)
+    {
+        int64_t executable = (ask < bid ? ask : bid);
+        int64_t imbalance  = (ask < bid ? bid - ask : ask - bid);
+        if(executable == 0) { return; }
+
+        if(executable > volume
+            || (executable == volume && imbalance < best_imbalance)
+            || (executable == volume && imbalance == best_imbalance
+                && llabs((int64_t)price - preferred_price) < llabs((int64_t)best - preferred_price))
+        )
+        {
+            best = price;
+            volume = executable;
+            best_imbalance = imbalance;
+        }
+    };
+
+    //
+    // cumulative sizes only change at level prices, so visit each distinct
+    // price in ascending order, then the gap of empty ticks up to the next
+    // one through its tick closest to preferred_price
+    //
+    int64_t ask_below = 0;  // asks priced at or below current price
+    size_t i = 0, j = bid_levels.size();
+    auto next_price = [&]()
+    {
+        return (j == 0 || (i < ask_levels.size() && ask_levels[i].price_ < bid_levels[j - 1].price_)
+                ? ask_levels[i].price_ : bid_levels[j - 1].price_);
+    };
+
+    while(i < ask_levels.size() || j > 0)
+    {
+        int32_t price = next_price();
+        int64_t bid_at = 0;
+        if(i < ask_levels.size() && ask_levels[i].price_ == price) { ask_below += ask_levels[i++].size_; }
+        if(j > 0 && bid_levels[j - 1].price_ == price)             { bid_at = bid_levels[--j].size_; }
+
+        evaluate(price, ask_below, bid_above);
+        bid_above -= bid_at;
+
+        if(i == ask_levels.size() && j == 0) { break; }
+        int32_t next = next_price();
+        if(next - price > tick_price)
+        {
+            int32_t gap_price = std::max(price + tick_price, std::min(next - tick_price, preferred_price));
+            evaluate(gap_price, ask_below, bid_above);
+        }
+    }
+
+    return best;
+}
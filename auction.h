@@ -0,0 +1,50 @@
+//
+// Helpers for call auction uncrossing. Cumulative ask & bid sizes over the
+// dense price range between best ask and best bid are built with SIMD prefix
+// sums, then scanned once for the equilibrium price. Sparse books are
+// scanned over their distinct level prices instead.
+//
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+//
+// total size of one non-empty price level
+//
+typedef struct LevelSize
+{
+    int32_t price_ = 0;
+    int64_t size_  = 0;
+
+    LevelSize() {}
+    LevelSize(int32_t price, int64_t size) : price_(price), size_(size) {}
+} LevelSize;
+
+/*
+ * in-place inclusive prefix sum of values
+ */
+void AuctionPrefixSum(int64_t* values, int count);
+
+/*
+ * ask_sizes[k]: ask size at price (best ask + k ticks)
+ * bid_sizes[k]: bid size at price (best bid - k ticks)
+ * preferred   : index of reference price, used as the last tie breaker
+ *
+ * both arrays are turned into cumulative sizes. Return index k of price
+ * (best ask + k ticks) maximizing executable volume, then minimizing
+ * imbalance, then closest to preferred. Return -1 if nothing executable
+ */
+int SearchEquilibrium(int64_t* ask_sizes, int64_t* bid_sizes, int count, int preferred, int64_t& volume);
+
+/*
+ * ask_levels: non-empty ask levels within [best ask, best bid], ascending
+ * bid_levels: non-empty bid levels within [best ask, best bid], descending
+ * preferred_price: reference price on tick grid, the last tie breaker
+ *
+ * same rules as SearchEquilibrium, in O(levels) however wide the range is.
+ * Return equilibrium price, 0 if nothing executable
+ */
+int32_t SearchSparseEquilibrium(const vector<LevelSize>& ask_levels, const vector<LevelSize>& bid_levels,
+                                int32_t tick_price, int32_t preferred_price, int64_t& volume);
@@ -0,0 +1,217 @@
+//
+// Load generator for OrderGateway. Each connection keeps a window of
+// orders in flight and measures round trip latency from send to ack.
+//
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <random>
+using namespace std;
+
+#include "comm/util/logutil.h"
+#include "comm/util/strutil.h"
+#include "comm/kit/cmdline_parser.h"
+
+#include "order_gateway.h"
+
+typedef chrono::steady_clock Clock;
+
+typedef struct ClientConn
+{
+    int                   fd_     = -1;
+    int                   sent_   = 0;
+    int                   acked_  = 0;
+    string                in_buf_;
+    deque<Clock::time_point> inflight_;
+} ClientConn;
+
+void Help(int argc, char* argv[])
+{
+    fprintf(stderr, "usage:%s -h [-a address] [-c conns] [-n orders] [-w window] [-p price] [-s spread]\n"
+                    "where:\n"
+                    "-a address: unix:path or host:port of gateway, default 127.0.0.1:9000\n"
+                    "-c conns  : connections, default 4\n"
+                    "-n orders : orders sent on each connection, default 100000\n"
+                    "-w window : orders in flight on each connection, default 16\n"
+                    "-p price  : mid price of generated orders, default 10000\n"
+                    "-s spread : orders are priced within mid +- spread ticks, default 50\n",
+                    argv[0]);
+    exit(0);
+}
+
+int Connect(const string& address)
+{
+    int fd = -1;
+    if(address.compare(0, 5, "unix:") == 0)
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, address.c_str() + 5, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd != -1 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    size_t colon = address.rfind(':');
+    if(colon == string::npos) { return -1; }
+
+    struct addrinfo hints, *result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(address.substr(0, colon).c_str(), address.c_str() + colon + 1, &hints, &result) != 0)
+    {
+        return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd != -1 && connect(fd, result->ai_addr, result->ai_addrlen) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    int on = 1;
+    if(fd != -1) { setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); }
+    return fd;
+}
+
+int main(int argc, char* argv[])
+{
+    CommUtil::CmdLineParser parser("ha:c:n:w:p:s:");
+    parser.Parse(argc, argv);
+    if(parser.Has('h'))
+    {
+        Help(argc, argv);
+    }
+
+    string address = (parser.Has('a') ? parser.Get('a') : "127.0.0.1:9000");
+    int conns  = (parser.Has('c') ? parser.GetInt('c') : 4);
+    int orders = (parser.Has('n') ? parser.GetInt('n') : 100000);
+    int window = (parser.Has('w') ? parser.GetInt('w') : 16);
+    int mid    = (parser.Has('p') ? parser.GetInt('p') : 10000);
+    int spread = (parser.Has('s') ? parser.GetInt('s') : 50);
+
+    vector<ClientConn> clients(conns);
+    vector<struct pollfd> fds(conns);
+    for(int i = 0; i < conns; i++)
+    {
+        clients[i].fd_ = Connect(address);
+        if(clients[i].fd_ == -1)
+        {
+            LOG_ERROR("connect to %s failed, errno:%d", address.c_str(), errno);
+            return 1;
+        }
+        fds[i].fd     = clients[i].fd_;
+        fds[i].events = POLLIN;
+    }
+
+    mt19937 rng(20210602);
+    uniform_int_distribution<int> offset(-spread, spread);
+    vector<int64_t> latencies;
+    latencies.reserve((size_t)conns * orders);
+    int64_t fills = 0, rejects = 0;
+    int done = 0;
+
+    auto start = Clock::now();
+    while(done < conns)
+    {
+        //
+        // top up window of each connection with one write
+        //
+        for(int i = 0; i < conns; i++)
+        {
+            ClientConn& client = clients[i];
+            vector<BinaryOrderMsg> msgs;
+            while(client.sent_ < orders && (int)client.inflight_.size() + (int)msgs.size() < window)
+            {
+                string id = CommUtil::ToStr((int64_t)i * orders + client.sent_++);
+                OrderCommand command;
+                command.action_ = 'A';
+                command.type_   = (rng() % 2 == 0 ? OrderType_Ask : OrderType_Bid);
+                command.size_   = 1 + rng() % 100;
+                command.price_  = mid + offset(rng);
+                command.id_     = id.data();
+                command.id_len_ = id.size();
+                msgs.resize(msgs.size() + 1);
+                EncodeBinaryOrder(command, msgs.back());
+            }
+            if(msgs.empty()) { continue; }
+
+            auto now = Clock::now();
+            size_t len = msgs.size() * sizeof(BinaryOrderMsg);
+            if(write(client.fd_, msgs.data(), len) != (ssize_t)len)
+            {
+                LOG_ERROR("write to gateway failed, errno:%d", errno);
+                return 1;
+            }
+            client.inflight_.insert(client.inflight_.end(), msgs.size(), now);
+        }
+
+        if(poll(fds.data(), conns, 1000) <= 0) { continue; }
+
+        for(int i = 0; i < conns; i++)
+        {
+            if(!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) { continue; }
+
+            ClientConn& client = clients[i];
+            char buf[64 * 1024];
+            ssize_t ret = recv(client.fd_, buf, sizeof(buf), MSG_DONTWAIT);
+            if(ret <= 0)
+            {
+                LOG_ERROR("gateway closed connection, errno:%d", errno);
+                return 1;
+            }
+            client.in_buf_.append(buf, ret);
+
+            auto now = Clock::now();
+            size_t pos = 0;
+            for(; pos + sizeof(BinaryReportMsg) <= client.in_buf_.size(); pos += sizeof(BinaryReportMsg))
+            {
+                BinaryReportMsg report;
+                memcpy(&report, client.in_buf_.data() + pos, sizeof(report));
+                if(report.type_ == ReportType_Fill)
+                {
+                    fills++;
+                    continue;
+                }
+
+                // acks come back in send order on each connection
+                if(report.type_ == ReportType_Reject) { rejects++; }
+                latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(now - client.inflight_.front()).count());
+                client.inflight_.pop_front();
+                if(++client.acked_ == orders) { done++; }
+            }
+            client.in_buf_.erase(0, pos);
+        }
+    }
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[min(latencies.size() - 1, (size_t)(p * latencies.size()))] / 1000.0; };
+    printf("orders:%zu fills:%lld rejects:%lld in %.3fs, %.0f orders/s\n",
+           latencies.size(), (long long)fills, (long long)rejects, elapsed, latencies.size() / elapsed);
+    printf("round trip us: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+           percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), latencies.back() / 1000.0);
+
+    for(auto& client : clients)
+    {
+        close(client.fd_);
+    }
+    return 0;
+}
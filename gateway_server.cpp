@@ -0,0 +1,66 @@
+//
+// Order entry server: an OrderBook behind OrderGateway.
+//
+#include <signal.h>
+#include <string.h>
+
+#include "comm/util/logutil.h"
+#include "comm/util/strutil.h"
+#include "comm/kit/cmdline_parser.h"
+
+#include "orderbook.h"
+#include "order_gateway.h"
+
+OrderGateway* gateway = NULL;
+
+void Help(int argc, char* argv[])
+{
+    fprintf(stderr, "usage:%s -h [-l address] [-c comp] [-t tick_price] [-s] [-v]\n"
+                    "where:\n"
+                    "-l address: unix:path or host:port to listen on, default 127.0.0.1:9000\n"
+                    "-c comp: the comparator for order id, support int & string only, default int\n"
+                    "-t tick_price: the initial tick price, default 1\n"
+                    "-s: accept session control commands T, C & U from clients\n"
+                    "-v: trace every book operation to stdout\n",
+                    argv[0]);
+    exit(0);
+}
+
+void OnSignal(int sig)
+{
+    if(gateway) { gateway->Stop(); }
+}
+
+int main(int argc, char* argv[])
+{
+    CommUtil::CmdLineParser parser("hl:c:t:sv");
+    parser.Parse(argc, argv);
+    if(parser.Has('h'))
+    {
+        Help(argc, argv);
+    }
+
+    OrderIdLessFunc less_func =
+            (parser.Get('c') && (strcmp(parser.Get('c'), "string") == 0)) ? OrderIdLessString : OrderIdLessInteger;
+    int tick_price = (parser.Has('t') ? CommUtil::StrToInt(parser.Get('t')) : 1);
+    string address = (parser.Has('l') ? parser.Get('l') : "127.0.0.1:9000");
+
+    orderbook_trace = parser.Has('v');
+
+    OrderBook book(tick_price, less_func);
+    OrderGateway order_gateway(book, parser.Has('s'));
+    if(order_gateway.Listen(address) != 0)
+    {
+        return 1;
+    }
+
+    gateway = &order_gateway;
+    signal(SIGINT,  OnSignal);
+    signal(SIGTERM, OnSignal);
+    signal(SIGPIPE, SIG_IGN);
+    order_gateway.Run();
+
+    LOG_DEBUG("clearing orderbook");
+    book.Clear();
+    return 0;
+}
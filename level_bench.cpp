@@ -0,0 +1,154 @@
+//
+// Benchmark of price level containers on dense & sparse order flow. Dense
+// flow keeps prices in a narrow band around mid and crosses the spread now
+// and then, sparse flow scatters resting orders over a wide price range.
+// Operations are generated up front, so every container replays the same.
+//
+#include <stdio.h>
+#include <chrono>
+#include <random>
+using namespace std;
+
+#include "comm/util/strutil.h"
+#include "comm/kit/cmdline_parser.h"
+
+#include "orderbook.h"
+
+void Help(int argc, char* argv[])
+{
+    fprintf(stderr, "usage:%s -h [-r range] [-d band] [-n orders] [-o ops] [-l container] [-w window] [-v]\n"
+                    "where:\n"
+                    "-r range    : price range in ticks of each side in sparse flow, default 1000000\n"
+                    "-d band     : price band in ticks of each side in dense flow, default 64\n"
+                    "              dense flow rests 8 orders per tick of band\n"
+                    "-n orders   : resting orders of sparse flow before measuring, default 100000\n"
+                    "-o ops      : measured delete & add pairs, default 1000000\n"
+                    "-l container: array, map, hybrid or all, default all\n"
+                    "-w window   : array window in ticks of hybrid container, at least 16, default 4096\n"
+                    "-v          : trace every book operation, off to keep it out of timing\n",
+                    argv[0]);
+    exit(0);
+}
+
+typedef struct Flow
+{
+    const char*       name_;
+    int               range_;       // max offset in ticks from mid
+    int               cross_;       // max offset in ticks to cross mid, 0 if never
+    int               orders_;      // resting orders before measuring
+    vector<OrderNode> resting_;
+    vector<int>       replaced_;    // index in resting_ of each operation
+    vector<OrderNode> added_;       // order added by each operation
+} Flow;
+
+/*
+ * asks rest above mid and bids below, offsets over cross_ ticks the other
+ * side of mid are aggressive and match
+ */
+int32_t NextPrice(mt19937& rng, const Flow& flow, OrderType type, int32_t mid)
+{
+    uniform_int_distribution<int> offset(-flow.cross_, flow.range_);
+    int o = offset(rng);
+    o = (o == 0 ? 1 : o);
+    return (type == OrderType_Ask ? mid + o : mid - o);
+}
+
+void GenerateFlow(Flow& flow, int32_t mid, int ops)
+{
+    mt19937 rng(20210602);
+    Flow passive = flow;
+    passive.cross_ = 0;
+
+    int orders = flow.orders_;
+    flow.resting_.resize(orders);
+    for(int i = 0; i < orders; i++)
+    {
+        OrderType type = (i % 2 == 0 ? OrderType_Ask : OrderType_Bid);
+        flow.resting_[i] = OrderNode(NextPrice(rng, passive, type, mid), CommUtil::ToStr(i), 1 + rng() % 10, type);
+    }
+
+    flow.replaced_.resize(ops);
+    flow.added_.resize(ops);
+    for(int i = 0; i < ops; i++)
+    {
+        flow.replaced_[i] = rng() % orders;
+        OrderType type = (rng() % 2 == 0 ? OrderType_Ask : OrderType_Bid);
+        flow.added_[i] = OrderNode(NextPrice(rng, flow, type, mid), CommUtil::ToStr(orders + i), 1 + rng() % 10, type);
+    }
+}
+
+void RunBench(const Flow& flow, const char* name, const LevelConfig& level_config)
+{
+    OrderBook book(1, OrderIdLessInteger, 2 * flow.range_ + 2, 2 * flow.range_ + 2, AllocPolicy(), level_config);
+    vector<OrderNode> resting = flow.resting_;
+    for(auto& order_node : resting)
+    {
+        book.AddOrder(order_node);
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    // replace a resting order, which may be filled already, by a new one
+    int ops = (int)flow.added_.size();
+    for(int i = 0; i < ops; i++)
+    {
+        OrderNode& order_node = resting[flow.replaced_[i]];
+        book.DeleteOrder(order_node);
+        order_node = flow.added_[i];
+        book.AddOrder(order_node);
+    }
+
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%-6s %-7s %8.1f ns/op\n", flow.name_, name, (double)elapsed / ops);
+
+    book.Clear();
+}
+
+int main(int argc, char* argv[])
+{
+    CommUtil::CmdLineParser parser("hr:d:n:o:l:w:v");
+    parser.Parse(argc, argv);
+    if(parser.Has('h'))
+    {
+        Help(argc, argv);
+    }
+
+    int range  = (parser.Has('r') ? parser.GetInt('r') : 1000000);
+    int band   = (parser.Has('d') ? parser.GetInt('d') : 64);
+    int orders = (parser.Has('n') ? parser.GetInt('n') : 100000);
+    int ops    = (parser.Has('o') ? parser.GetInt('o') : 1000000);
+    int window = (parser.Has('w') ? parser.GetInt('w') : 4096);
+    string which = (parser.Has('l') ? parser.Get('l') : "all");
+    orderbook_trace = parser.Has('v');
+
+    const struct
+    {
+        const char*    name_;
+        LevelContainer container_;
+    } containers[] = {
+        {"array",  LevelContainer_Array},
+        {"map",    LevelContainer_Map},
+        {"hybrid", LevelContainer_Hybrid},
+    };
+
+    Flow flows[] = {
+        {"dense",  band,  band / 8, band * 8},
+        {"sparse", range, 0,        orders},
+    };
+
+    const int32_t mid = range + band + 1;
+    for(auto& flow : flows)
+    {
+        GenerateFlow(flow, mid, ops);
+        for(auto& container : containers)
+        {
+            if(which != "all" && which != container.name_) { continue; }
+
+            LevelConfig level_config(container.container_);
+            level_config.window_size_ = window;
+            RunBench(flow, container.name_, level_config);
+        }
+    }
+
+    return 0;
+}
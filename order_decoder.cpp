@@ -0,0 +1,254 @@
+//
+// binary & text order entry decoders, see order_decoder.h
+//
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <string.h>
+
+#include "comm/util/logutil.h"
+
+#include "order_decoder.h"
+
+static bool IsValidAction(char action)
+{
+    return action == 'A' || action == 'X' || action == 'T' || action == 'C' || action == 'U';
+}
+
+/*
+ * orders from network need a non-empty id & positive size, and added
+ * orders a non-negative price
+ */
+static bool IsValidOrderMsg(const BinaryOrderMsg& msg)
+{
+    if(msg.action_ != 'A' && msg.action_ != 'X') { return true; }
+
+    return msg.id_len_ > 0 && msg.size_ > 0 && (msg.action_ == 'X' || msg.price_ >= 0);
+}
+
+static bool GetSideType(char side, OrderType& type)
+{
+    switch(side)
+    {
+        case 'S': type = OrderType_Ask; return true;
+        case 'B': type = OrderType_Bid; return true;
+        default : return false;
+    }
+}
+
+size_t DecodeBinaryOrders(const char* buf, size_t len, vector<OrderCommand>& commands)
+{
+    size_t count = len / sizeof(BinaryOrderMsg);
+    for(size_t i = 0; i < count; i++)
+    {
+        // buffer may be unaligned, copy header fields out instead of casting
+        BinaryOrderMsg msg;
+        const char* data = buf + i * sizeof(BinaryOrderMsg);
+        memcpy(&msg, data, offsetof(BinaryOrderMsg, id_));
+
+        OrderCommand command;
+        if(!IsValidAction(msg.action_) || !GetSideType(msg.side_, command.type_)
+            || msg.kind_ > OrderKind_StopLimit || msg.id_len_ > sizeof(msg.id_) || !IsValidOrderMsg(msg))
+        {
+            LOG_ERROR("invalid binary order message at offset:%zu", i * sizeof(BinaryOrderMsg));
+            commands.push_back(OrderCommand());
+            continue;
+        }
+
+        command.action_     = msg.action_;
+        command.kind_       = (OrderKind)msg.kind_;
+        command.size_       = msg.size_;
+        command.price_      = msg.price_;
+        command.stop_price_ = msg.stop_price_;
+        command.id_         = data + offsetof(BinaryOrderMsg, id_);
+        command.id_len_     = msg.id_len_;
+        commands.push_back(command);
+    }
+
+    return count * sizeof(BinaryOrderMsg);
+}
+
+int EncodeBinaryOrder(const OrderCommand& command, BinaryOrderMsg& msg)
+{
+    if(command.id_len_ > sizeof(msg.id_))
+    {
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.action_     = command.action_;
+    msg.side_       = (command.type_ == OrderType_Ask ? 'S' : 'B');
+    msg.kind_       = command.kind_;
+    msg.id_len_     = command.id_len_;
+    msg.size_       = command.size_;
+    msg.price_      = command.price_;
+    msg.stop_price_ = command.stop_price_;
+    memcpy(msg.id_, command.id_, command.id_len_);
+    return 0;
+}
+
+/*
+ * parse decimal integer in [begin, end), return false on non digit
+ */
+static bool ParseInt32(const char* begin, const char* end, int32_t& value)
+{
+    bool negative = (begin < end && *begin == '-');
+    if(negative) { begin++; }
+    if(begin == end) { return false; }
+
+    int64_t v = 0;
+    for(; begin < end; begin++)
+    {
+        unsigned digit = (unsigned)(*begin - '0');
+        if(digit > 9) { return false; }
+        v = v * 10 + digit;
+        if(v > INT32_MAX) { return false; }
+    }
+
+    value = (int32_t)(negative ? -v : v);
+    return true;
+}
+
+//
+// field boundaries of the current line. ends_[i] is the delimiter position
+// of field i, field i starts right after ends_[i - 1]
+//
+typedef struct TextLine
+{
+    static const int kMaxFields = 6;
+
+    const char* begin_  = NULL;
+    const char* ends_[kMaxFields];
+    int         fields_ = 0;    // more than kMaxFields makes the line invalid
+} TextLine;
+
+static void ParseTextLine(const TextLine& line, const char* end, vector<OrderCommand>& commands)
+{
+    const char* begin = line.begin_;
+    while(begin < end && (*begin == ' ' || *begin == '\t')) { begin++; }
+    if(end > begin && end[-1] == '\r') { end--; }
+    if(begin == end || *begin == '#')
+    {
+        return;
+    }
+
+    int fields = line.fields_ + 1;
+    if(fields != 5 && fields != 6)
+    {
+        LOG_ERROR("ignore line(%.*s) with fields:%d", (int)(end - begin), begin, fields);
+        return;
+    }
+
+    const char* starts[TextLine::kMaxFields];
+    const char* ends[TextLine::kMaxFields];
+    starts[0] = begin;
+    for(int i = 0; i < fields - 1; i++)
+    {
+        ends[i]       = line.ends_[i];
+        starts[i + 1] = line.ends_[i] + 1;
+    }
+    ends[fields - 1] = end;
+
+    OrderCommand command;
+    command.action_ = *starts[0];
+    command.id_     = starts[1];
+    command.id_len_ = ends[1] - starts[1];
+    if(ends[0] - starts[0] != 1 || !IsValidAction(command.action_)
+        || ends[2] - starts[2] != 1 || !GetSideType(*starts[2], command.type_)
+        || !ParseInt32(starts[3], ends[3], command.size_)
+        || !ParseInt32(starts[4], ends[4], command.price_)
+        || (fields == 6 && !ParseInt32(starts[5], ends[5], command.stop_price_))
+    )
+    {
+        LOG_ERROR("ignore invalid line(%.*s)", (int)(end - begin), begin);
+        return;
+    }
+
+    // optional stop price, market order if price is 0
+    if(fields == 6)
+    {
+        command.kind_ = (command.price_ == 0 ? OrderKind_Stop : OrderKind_StopLimit);
+    }
+    else if(command.price_ == 0)
+    {
+        command.kind_ = OrderKind_Market;
+    }
+
+    commands.push_back(command);
+}
+
+size_t ParseTextOrders(const char* buf, size_t len, vector<OrderCommand>& commands, bool eof)
+{
+    TextLine line;
+    line.begin_ = buf;
+
+    auto on_delimiter = [&](size_t pos)
+    {
+        if(buf[pos] == ',')
+        {
+            if(line.fields_ < TextLine::kMaxFields) { line.ends_[line.fields_] = buf + pos; }
+            line.fields_++;
+            return;
+        }
+
+        ParseTextLine(line, buf + pos, commands);
+        line.begin_  = buf + pos + 1;
+        line.fields_ = 0;
+    };
+
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i comma   = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(buf + i));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, comma), _mm_cmpeq_epi8(x, newline)));
+        while(mask != 0)
+        {
+            on_delimiter(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for(; i < len; i++)
+    {
+        if(buf[i] == ',' || buf[i] == '\n')
+        {
+            on_delimiter(i);
+        }
+    }
+
+    if(eof && line.begin_ < buf + len)
+    {
+        ParseTextLine(line, buf + len, commands);
+        return len;
+    }
+
+    return line.begin_ - buf;
+}
+
+int ApplyOrderCommand(OrderBook& book, const OrderCommand& command, OrderNode& order_node)
+{
+    order_node.id_.assign(command.id_, command.id_len_);
+    order_node.type_       = command.type_;
+    order_node.kind_       = command.kind_;
+    order_node.size_       = command.size_;
+    order_node.price_      = command.price_;
+    order_node.stop_price_ = command.stop_price_;
+
+    switch(command.action_)
+    {
+        case 'A': if(!book.AddOrder(order_node)) { return -1; } break;
+        case 'X': book.DeleteOrder(order_node); break;
+        case 'T': book.ResetTickPrice(order_node.price_); break;
+        case 'C': book.SetAuctionMode(true); break;
+        case 'U': book.Uncross(); break;
+        default :
+            LOG_ERROR("invalid action:%c", command.action_);
+            return -1;
+    }
+
+    return 0;
+}
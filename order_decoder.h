@@ -0,0 +1,76 @@
+//
+// Order entry decoders. Both decode whole buffers in place into
+// OrderCommand without per-message allocation:
+//  - fixed layout binary messages, see BinaryOrderMsg
+//  - text lines of format [A|X|T|C|U],[order_id],[S|B],[size],[price][,stop_price]
+//    tokenized with SIMD delimiter search
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+#include "orderbook.h"
+
+//
+// decoded order command. id_ points into the decoded buffer, so the buffer
+// must outlive the command
+//
+typedef struct OrderCommand
+{
+    char        action_     = 0;    // A(add), X(delete), T(tick price), C(call auction), U(uncross)
+    OrderType   type_       = OrderType_Min_Invalid;
+    OrderKind   kind_       = OrderKind_Limit;
+    int32_t     size_       = 0;
+    int32_t     price_      = 0;
+    int32_t     stop_price_ = 0;
+    const char* id_         = NULL; // not NUL terminated
+    uint32_t    id_len_     = 0;
+} OrderCommand;
+
+//
+// binary order entry message, little endian & packed, 32 bytes. A & X need
+// a non-empty id and positive size, A a non-negative price
+//
+#pragma pack(push, 1)
+typedef struct BinaryOrderMsg
+{
+    uint8_t action_;        // same as OrderCommand::action_
+    uint8_t side_;          // 'S' or 'B'
+    uint8_t kind_;          // OrderKind
+    uint8_t id_len_;        // valid bytes of id_
+    int32_t size_;
+    int32_t price_;
+    int32_t stop_price_;
+    char    id_[16];
+} BinaryOrderMsg;
+#pragma pack(pop)
+
+static_assert(sizeof(BinaryOrderMsg) == 32, "BinaryOrderMsg must be 32 bytes");
+
+/*
+ * decode all complete binary messages in buf into commands. Invalid
+ * messages are kept with action_ 0, so that responses stay in message
+ * order. Return bytes consumed, always a multiple of message size
+ */
+size_t DecodeBinaryOrders(const char* buf, size_t len, vector<OrderCommand>& commands);
+
+/*
+ * encode command into binary message, return -1 if id is too long
+ */
+int EncodeBinaryOrder(const OrderCommand& command, BinaryOrderMsg& msg);
+
+/*
+ * parse all complete text lines in buf into commands. Comment(#) & blank
+ * lines are skipped, invalid lines are logged & skipped. The last line
+ * without trailing newline is parsed only if eof. Return bytes consumed
+ */
+size_t ParseTextOrders(const char* buf, size_t len, vector<OrderCommand>& commands, bool eof);
+
+/*
+ * apply command on book, order_node is scratch storage reused across calls.
+ * Return -1 for unknown action or order rejected by book
+ */
+int ApplyOrderCommand(OrderBook& book, const OrderCommand& command, OrderNode& order_node);
@@ -0,0 +1,444 @@
+//
+// epoll based order entry gateway, see order_gateway.h
+//
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "comm/util/logutil.h"
+
+#include "order_gateway.h"
+
+static const int    kMaxEvents = 256;
+static const size_t kReadSize  = 64 * 1024;
+
+OrderGateway::OrderGateway(OrderBook &book, bool session_control) : book_(book), session_control_(session_control)
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    book_.SetFillListener(this);
+}
+
+OrderGateway::~OrderGateway()
+{
+    book_.SetFillListener(NULL);
+
+    for(auto& iter : connections_)
+    {
+        close(iter.first);
+        delete iter.second;
+    }
+    if(listen_fd_ != -1)
+    {
+        close(listen_fd_);
+    }
+    if(!unix_path_.empty())
+    {
+        unlink(unix_path_.c_str());
+    }
+    if(epoll_fd_ != -1)
+    {
+        close(epoll_fd_);
+    }
+}
+
+int OrderGateway::Listen(const string &address)
+{
+    if(epoll_fd_ == -1)
+    {
+        LOG_ERROR("epoll create failed, errno:%d", errno);
+        return -1;
+    }
+
+    int fd = -1;
+    if(address.compare(0, 5, "unix:") == 0)
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        string path = address.substr(5);
+        if(path.size() >= sizeof(addr.sun_path))
+        {
+            LOG_ERROR("unix socket path too long:%s", path.c_str());
+            return -1;
+        }
+        strcpy(addr.sun_path, path.c_str());
+        unlink(path.c_str());
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(fd == -1 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            LOG_ERROR("bind unix socket:%s failed, errno:%d", path.c_str(), errno);
+            if(fd != -1) { close(fd); }
+            return -1;
+        }
+        unix_path_ = path;
+    }
+    else
+    {
+        size_t colon = address.rfind(':');
+        if(colon == string::npos)
+        {
+            LOG_ERROR("invalid listen address:%s", address.c_str());
+            return -1;
+        }
+
+        struct addrinfo hints, *result = NULL;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags    = AI_PASSIVE;
+        string host = address.substr(0, colon);
+        if(getaddrinfo(host.empty() ? NULL : host.c_str(), address.c_str() + colon + 1, &hints, &result) != 0)
+        {
+            LOG_ERROR("resolve listen address:%s failed", address.c_str());
+            return -1;
+        }
+
+        int on = 1;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(fd != -1) { setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)); }
+        if(fd == -1 || bind(fd, result->ai_addr, result->ai_addrlen) != 0)
+        {
+            LOG_ERROR("bind address:%s failed, errno:%d", address.c_str(), errno);
+            if(fd != -1) { close(fd); }
+            freeaddrinfo(result);
+            return -1;
+        }
+        freeaddrinfo(result);
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events  = EPOLLIN | EPOLLET;
+    event.data.fd = fd;
+    if(listen(fd, SOMAXCONN) != 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        LOG_ERROR("listen on address:%s failed, errno:%d", address.c_str(), errno);
+        close(fd);
+        return -1;
+    }
+
+    listen_fd_ = fd;
+    LOG_INFO("order gateway listening on %s", address.c_str());
+    return 0;
+}
+
+int OrderGateway::RunOnce(int timeout_ms)
+{
+    struct epoll_event events[kMaxEvents];
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+    if(n < 0)
+    {
+        if(errno == EINTR) { return 0; }
+        LOG_ERROR("epoll wait failed, errno:%d", errno);
+        return -1;
+    }
+
+    //
+    // drain all readable connections into one batch before matching
+    //
+    batch_.clear();
+    for(int i = 0; i < n; i++)
+    {
+        if(events[i].data.fd == listen_fd_)
+        {
+            Accept();
+            continue;
+        }
+
+        auto iter = connections_.find(events[i].data.fd);
+        if(iter == connections_.end()) { continue; }
+        if(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        {
+            ReadConnection(iter->second);
+        }
+    }
+
+    for(auto& item : batch_)
+    {
+        const OrderCommand& command = item.command_;
+        Connection* conn = item.conn_;
+        int32_t seq = conn->seq_++;
+
+        bool rejected = false;
+        if(command.action_ == 'T' || command.action_ == 'C' || command.action_ == 'U')
+        {
+            rejected = !session_control_;
+            if(rejected)
+            {
+                LOG_DEBUG("reject session control %c from fd:%d", command.action_, conn->fd_);
+            }
+        }
+        else if(command.action_ == 'A' || command.action_ == 'X')
+        {
+            //
+            // a live id belongs to the connection adding it, which alone gets
+            // its fills and may delete it. Liveness is taken from the book, as
+            // orders of closed connections rest without owner and keep their ids
+            //
+            string id(command.id_, command.id_len_);
+            bool live = book_.HasOrder(id);
+            if(command.action_ == 'A')
+            {
+                rejected = live;
+                if(!rejected) { order_owners_[id] = conn; }
+            }
+            else
+            {
+                auto owner = order_owners_.find(id);
+                rejected = (!live || owner == order_owners_.end() || owner->second != conn);
+            }
+
+            if(rejected)
+            {
+                LOG_DEBUG("reject %c of order id:%s from fd:%d, owned by other connection or not live",
+                          command.action_, id.c_str(), conn->fd_);
+            }
+        }
+
+        if(rejected)
+        {
+            AddReport(conn, ReportType_Reject, command.action_, command.type_,
+                      command.id_, command.id_len_, command.size_, command.price_, seq);
+            continue;
+        }
+
+        //
+        // ack goes ahead of the fills reported while applying, so queue it
+        // first and turn it into reject if the book refuses the command
+        //
+        size_t ack_index = conn->reports_.size();
+        AddReport(conn, ReportType_Ack, command.action_, command.type_,
+                  command.id_, command.id_len_, command.size_, command.price_, seq);
+        if(ApplyOrderCommand(book_, command, order_node_) != 0)
+        {
+            conn->reports_[ack_index].type_ = ReportType_Reject;
+            if(command.action_ == 'A') { order_owners_.erase(order_node_.id_); }
+            continue;
+        }
+
+        // market remainder is dropped and deleted order is gone
+        if(command.action_ == 'X' || (command.action_ == 'A' && command.kind_ == OrderKind_Market))
+        {
+            order_owners_.erase(order_node_.id_);
+        }
+    }
+
+    //
+    // decoded messages are applied, drop them from read buffers and write
+    // back reports, including reports of fills on idle connections
+    //
+    for(auto& iter : connections_)
+    {
+        Connection* conn = iter.second;
+        if(conn->decoded_ > 0)
+        {
+            conn->in_len_ -= conn->decoded_;
+            memmove(conn->in_buf_.data(), conn->in_buf_.data() + conn->decoded_, conn->in_len_);
+            conn->decoded_ = 0;
+        }
+        if(!conn->closed_ && (!conn->reports_.empty() || !conn->out_buf_.empty()))
+        {
+            FlushConnection(conn);
+        }
+        conn->reports_.clear();
+    }
+
+    for(auto iter = connections_.begin(); iter != connections_.end(); )
+    {
+        Connection* conn = iter->second;
+        if(!conn->closed_)
+        {
+            ++iter;
+            continue;
+        }
+
+        for(auto owner = order_owners_.begin(); owner != order_owners_.end(); )
+        {
+            if(owner->second == conn) { owner = order_owners_.erase(owner); }
+            else { ++owner; }
+        }
+        LOG_DEBUG("close connection fd:%d", conn->fd_);
+        close(conn->fd_);
+        delete conn;
+        iter = connections_.erase(iter);
+    }
+
+    return (int)batch_.size();
+}
+
+void OrderGateway::Run()
+{
+    running_ = true;
+    while(running_)
+    {
+        if(RunOnce(100) < 0) { break; }
+    }
+}
+
+void OrderGateway::Stop()
+{
+    running_ = false;
+}
+
+void OrderGateway::OnFill(const OrderNode &resting, const OrderNode &incoming, int32_t price, int32_t size)
+{
+    auto iter = order_owners_.find(resting.id_);
+    if(iter != order_owners_.end())
+    {
+        AddReport(iter->second, ReportType_Fill, 'A', resting.type_,
+                  resting.id_.data(), resting.id_.size(), size, price, -1);
+        if(resting.size_ == size) { order_owners_.erase(iter); }
+    }
+
+    iter = order_owners_.find(incoming.id_);
+    if(iter != order_owners_.end())
+    {
+        AddReport(iter->second, ReportType_Fill, 'A', incoming.type_,
+                  incoming.id_.data(), incoming.id_.size(), size, price, -1);
+        if(incoming.size_ == size) { order_owners_.erase(iter); }
+    }
+}
+
+void OrderGateway::Accept()
+{
+    while(true)
+    {
+        int fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("accept failed, errno:%d", errno);
+            }
+            if(errno == EINTR) { continue; }
+            return;
+        }
+
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events  = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+        if(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            LOG_ERROR("add connection fd:%d into epoll failed, errno:%d", fd, errno);
+            close(fd);
+            continue;
+        }
+
+        Connection* conn = new Connection;
+        conn->fd_ = fd;
+        connections_[fd] = conn;
+        LOG_DEBUG("accept connection fd:%d", fd);
+    }
+}
+
+void OrderGateway::ReadConnection(Connection *conn)
+{
+    // edge triggered, so read until EAGAIN
+    while(!conn->closed_)
+    {
+        if(conn->in_buf_.size() - conn->in_len_ < kReadSize)
+        {
+            conn->in_buf_.resize(conn->in_len_ + kReadSize);
+        }
+
+        ssize_t ret = read(conn->fd_, conn->in_buf_.data() + conn->in_len_, conn->in_buf_.size() - conn->in_len_);
+        if(ret > 0)
+        {
+            conn->in_len_ += ret;
+            continue;
+        }
+
+        if(ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            conn->closed_ = true;
+        }
+        else if(errno != EINTR)
+        {
+            break;
+        }
+    }
+
+    // messages point into in_buf_, which stays untouched until batch applied
+    commands_.clear();
+    conn->decoded_ = DecodeBinaryOrders(conn->in_buf_.data(), conn->in_len_, commands_);
+    for(auto& command : commands_)
+    {
+        BatchItem item;
+        item.conn_    = conn;
+        item.command_ = command;
+        batch_.push_back(item);
+    }
+}
+
+void OrderGateway::FlushConnection(Connection *conn)
+{
+    struct iovec iov[2];
+    iov[0].iov_base = &conn->out_buf_[0];
+    iov[0].iov_len  = conn->out_buf_.size();
+    iov[1].iov_base = conn->reports_.data();
+    iov[1].iov_len  = conn->reports_.size() * sizeof(BinaryReportMsg);
+
+    size_t  total   = iov[0].iov_len + iov[1].iov_len;
+    ssize_t written = 0;
+    do
+    {
+        written = writev(conn->fd_, iov, 2);
+    } while(written < 0 && errno == EINTR);
+
+    if(written < 0)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            conn->closed_ = true;
+            return;
+        }
+        written = 0;
+    }
+
+    //
+    // keep unsent bytes, EPOLLOUT edge will flush them later
+    //
+    if((size_t)written < iov[0].iov_len)
+    {
+        conn->out_buf_.erase(0, written);
+        conn->out_buf_.append((const char*)iov[1].iov_base, iov[1].iov_len);
+    }
+    else if((size_t)written < total)
+    {
+        size_t sent = written - iov[0].iov_len;
+        conn->out_buf_.assign((const char*)iov[1].iov_base + sent, iov[1].iov_len - sent);
+    }
+    else
+    {
+        conn->out_buf_.clear();
+    }
+}
+
+void OrderGateway::AddReport(Connection *conn, ReportType type, char action, OrderType side,
+                             const char *id, size_t id_len, int32_t size, int32_t price, int32_t seq)
+{
+    BinaryReportMsg report;
+    memset(&report, 0, sizeof(report));
+    report.type_   = type;
+    report.action_ = action;
+    report.side_   = (side == OrderType_Ask ? 'S' : 'B');
+    report.id_len_ = (uint8_t)std::min(id_len, sizeof(report.id_));
+    report.size_   = size;
+    report.price_  = price;
+    report.seq_    = seq;
+    memcpy(report.id_, id, report.id_len_);
+    conn->reports_.push_back(report);
+}
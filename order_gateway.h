@@ -0,0 +1,121 @@
+//
+// Local order entry gateway. A single thread serves TCP or unix socket
+// connections with edge-triggered epoll. Each loop iteration drains all
+// readable connections, decodes BinaryOrderMsg in place from per-connection
+// buffers, applies commands of all connections as one batch on the book,
+// then writes acks & fills back with writev.
+//
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "orderbook.h"
+#include "order_decoder.h"
+
+enum ReportType
+{
+    ReportType_Ack    = 'K',    // command applied
+    ReportType_Reject = 'R',    // invalid or not allowed command, or order id not owned
+    ReportType_Fill   = 'F',    // order filled by size_ at price_
+};
+
+//
+// report message sent back to clients, little endian & packed, 32 bytes
+//
+#pragma pack(push, 1)
+typedef struct BinaryReportMsg
+{
+    uint8_t type_;          // ReportType
+    uint8_t action_;        // action of acked command
+    uint8_t side_;          // 'S' or 'B'
+    uint8_t id_len_;        // valid bytes of id_
+    int32_t size_;
+    int32_t price_;
+    int32_t seq_;           // per connection sequence of acked command
+    char    id_[16];
+} BinaryReportMsg;
+#pragma pack(pop)
+
+static_assert(sizeof(BinaryReportMsg) == 32, "BinaryReportMsg must be 32 bytes");
+
+class OrderGateway : public FillListener
+{
+public:
+    /*
+     * session_control: accept T, C & U from clients, which change tick
+     * price & auction state for every connection
+     */
+    OrderGateway(OrderBook& book, bool session_control = false);
+
+    ~OrderGateway();
+
+    /*
+     * listen on "unix:path" or "host:port", return 0 on success
+     */
+    int Listen(const string& address);
+
+    /*
+     * run one loop iteration, waiting at most timeout_ms for events.
+     * Return number of commands applied, -1 on epoll failure
+     */
+    int RunOnce(int timeout_ms);
+
+    /*
+     * run loop until Stop
+     */
+    void Run();
+
+    void Stop();
+
+    virtual void OnFill(const OrderNode& resting, const OrderNode& incoming, int32_t price, int32_t size);
+
+private:
+    typedef struct Connection
+    {
+        int             fd_      = -1;
+        bool            closed_  = false;
+        int32_t         seq_     = 0;
+        vector<char>    in_buf_;        // received bytes not decoded yet
+        size_t          in_len_  = 0;   // valid bytes of in_buf_
+        size_t          decoded_ = 0;   // bytes of in_buf_ decoded in current batch
+        string          out_buf_;       // bytes not sent yet
+        vector<BinaryReportMsg> reports_;   // reports of current batch
+    } Connection;
+
+    typedef struct BatchItem
+    {
+        Connection*  conn_;
+        OrderCommand command_;
+    } BatchItem;
+
+    void Accept();
+
+    /*
+     * read until EAGAIN and decode complete messages into batch_
+     */
+    void ReadConnection(Connection* conn);
+
+    /*
+     * writev pending bytes and reports, keep unsent bytes in out_buf_
+     */
+    void FlushConnection(Connection* conn);
+
+    void AddReport(Connection* conn, ReportType type, char action, OrderType side,
+                   const char* id, size_t id_len, int32_t size, int32_t price, int32_t seq);
+
+    OrderBook&              book_;
+    int                     epoll_fd_  = -1;
+    int                     listen_fd_ = -1;
+    string                  unix_path_;
+    bool                    running_   = false;
+    bool                    session_control_;
+    map<int, Connection*>   connections_;
+    map<string, Connection*> order_owners_; // order id to connection of its owner
+    vector<BatchItem>       batch_;
+    vector<OrderCommand>    commands_;      // scratch for decoding
+    OrderNode               order_node_;    // scratch for ApplyOrderCommand
+};
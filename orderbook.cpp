@@ -2,10 +2,13 @@
 // Created by iscaswang on 2021/6/2.
 //
 #include <assert.h>
+#include <limits.h>
 
 #include "comm/util/logutil.h"
 
+#include "auction.h"
 #include "orderbook.h"
+#include "sparse_depth.h"
 
 bool OrderIdLessString(const OrderNode& a, const OrderNode& b)
 {
@@ -19,20 +22,138 @@ bool OrderIdLessInteger(const OrderNode& a, const OrderNode& b)
 
 const char* order_type_desc[] = {"ask", "bid"};
 
-Depth::Depth(int index_step,
-             int step_size,
-             int initial_size,
-             int type,
+bool orderbook_trace = true;
+
+static const int kMinWindowSize = 16;   // min ticks in array window of HybridDepth
+
+Depth::Depth(int type,
              int tick_price,
-             OrderIdLessFunc order_id_less_func
-    ) : index_step_(index_step), step_size_(step_size), type_(type),
-    tick_price_(tick_price), order_id_less_func_(order_id_less_func)
+             OrderIdLessFunc order_id_less_func,
+             const AllocPolicy& policy
+    ) : type_(type), tick_price_(tick_price), policy_(policy), order_pool_(policy),
+    map_link_nodes_(less<string>(), LinkNodeAllocator(&order_pool_)),
+    order_id_less_func_(order_id_less_func)
+{
+
+}
+
+void Depth::SetFillListener(FillListener* fill_listener)
+{
+    fill_listener_ = fill_listener;
+}
+
+void Depth::SetAnalytics(TradeAnalytics* analytics)
+{
+    analytics_ = analytics;
+}
+
+bool Depth::HasOrder(const string& id)
+{
+    return map_link_nodes_.find(id) != map_link_nodes_.end();
+}
+
+void Depth::MatchLevel(LinkNode<OrderNode>*& head, int64_t& level_size, OrderNode& order_node,
+                       int32_t cross_price, int idx)
+{
+    LinkNode<OrderNode>* node = head;
+    int32_t fill_price = (cross_price != 0 ? cross_price : node->value_.price_);
+    while(node && (order_node.size_ > 0))
+    {
+        int32_t fill_size = std::min(node->value_.size_, order_node.size_);
+        if(fill_listener_)
+        {
+            fill_listener_->OnFill(node->value_, order_node, fill_price, fill_size);
+        }
+        if(analytics_)
+        {
+            analytics_->OnTrade(fill_price, fill_size);
+        }
+
+        if(node->value_.size_ > order_node.size_)
+        {
+            LOG_BOOK_TRACE("fully consume %s price %d with size:%d, idx:%d",
+                        order_type_desc[type_], node->value_.price_, order_node.size_, idx);
+            node->value_.size_ -= order_node.size_;
+            level_size         -= order_node.size_;
+            order_node.size_    = 0;
+        }
+        else
+        {
+            LOG_BOOK_TRACE("partially consume %s price %d with size:%d, idx:%d",
+                        order_type_desc[type_], node->value_.price_, node->value_.size_, idx);
+            order_node.size_ -= node->value_.size_;
+            level_size       -= node->value_.size_;
+            map_link_nodes_.erase(node->value_.id_);
+            PopFrontLinkList(head);
+            node = head;
+        }
+    }
+}
+
+void Depth::PopLevel(LinkNode<OrderNode>*& head, int64_t& level_size, vector<OrderNode>& order_nodes, int idx)
+{
+    while(head)
+    {
+        LOG_BOOK_TRACE("pop crossed %s price %d with id:%s, idx:%d", order_type_desc[type_],
+                    head->value_.price_, head->value_.id_.c_str(), idx);
+        order_nodes.push_back(head->value_);
+        map_link_nodes_.erase(head->value_.id_);
+        PopFrontLinkList(head);
+    }
+    level_size = 0;
+}
+
+void Depth::AddLinkNode(LinkNode<OrderNode>*& head, int64_t& level_size, const OrderNode &order_node, int idx)
+{
+    LOG_BOOK_TRACE("add price:%d into %s idx:%d", order_node.price_, order_type_desc[type_], idx);
+    auto ret = InsertSortLinkList(head, order_node, false, order_id_less_func_);
+    if(ret.first == false)
+    {
+        LOG_BOOK_TRACE("ignore order node with same id:%s", order_node.id_.c_str());
+        return;
+    }
+
+    map_link_nodes_[order_node.id_] = ret.second;
+    level_size += order_node.size_;
+}
+
+void Depth::RemoveOrder(LinkNode<OrderNode>*& head, int64_t& level_size, LinkNodeMap::iterator iter)
+{
+    LinkNode<OrderNode>* link_node = iter->second;
+    level_size -= link_node->value_.size_;
+    map_link_nodes_.erase(iter);
+    RemoveLinkNode(head, link_node);
+}
+
+void Depth::PrintLevel(LinkNode<OrderNode>* head, int idx)
+{
+    LinkNode<OrderNode>* node = head;
+    printf("%d(%d): ", node->value_.price_, idx);
+    while(node)
+    {
+        assert(head->value_.price_ == node->value_.price_);
+        printf("%d(%s) ", node->value_.size_, node->value_.id_.c_str());
+        node = node->next_;
+    }
+    printf("\n");
+}
+
+ArrayDepth::ArrayDepth(int index_step,
+                       int step_size,
+                       int initial_size,
+                       int type,
+                       int tick_price,
+                       OrderIdLessFunc order_id_less_func,
+                       const AllocPolicy& policy
+    ) : Depth(type, tick_price, order_id_less_func, policy),
+    index_step_(index_step), step_size_(step_size)
 {
     price_nodes_ = CreateLinkNodeArray(initial_size);
+    level_sizes_ = CreateLevelSizeArray(initial_size);
     current_size_ = initial_size;
 }
 
-Depth::~Depth()
+ArrayDepth::~ArrayDepth()
 {
     for(int i = 0; i < current_size_; i++)
     {
@@ -42,10 +163,11 @@ Depth::~Depth()
         }
     }
 
-    delete []price_nodes_;
+    PolicyFree(price_nodes_);
+    PolicyFree(level_sizes_);
 }
 
-void Depth::Match(OrderNode &order_node)
+void ArrayDepth::Match(OrderNode &order_node, int32_t* low_price, int32_t* high_price, int32_t cross_price)
 {
     if(top_ < 0) { return; }
 
@@ -54,30 +176,16 @@ void Depth::Match(OrderNode &order_node)
     for(; (i <= elem_size) && (order_node.size_ > 0); i++, idx = (idx + 1) % current_size_)
     {
         if(price_nodes_[idx] == NULL) { continue; }
-        LinkNode<OrderNode>* node = price_nodes_[idx];
-        if((type_ == OrderType_Ask && price_nodes_[idx]->value_.price_ <= order_node.price_)
-            || (type_ == OrderType_Bid && price_nodes_[idx]->value_.price_ >= order_node.price_)
-        )
+        if(IsCrossed(price_nodes_[idx]->value_.price_, order_node.price_))
         {
-            while(node && (order_node.size_ > 0))
+            int32_t price = price_nodes_[idx]->value_.price_;
+            if(low_price && high_price)
             {
-                if(node->value_.size_ > order_node.size_)
-                {
-                    LOG_RAW_STDOUT("fully consume %s price %d with size:%d, idx:%d",
-                                order_type_desc[type_], node->value_.price_, order_node.size_, idx);
-                    node->value_.size_ -= order_node.size_;
-                    order_node.size_    = 0;
-                }
-                else
-                {
-                    LOG_RAW_STDOUT("partially consume %s price %d with size:%d, idx:%d",
-                                order_type_desc[type_], node->value_.price_, node->value_.size_, idx);
-                    order_node.size_ -= node->value_.size_;
-                    map_link_nodes_.erase(node->value_.id_);
-                    PopFrontLinkList(price_nodes_[idx]);
-                    node = price_nodes_[idx];
-                }
+                if(*low_price == 0 || price < *low_price)   *low_price  = price;
+                if(*high_price == 0 || price > *high_price) *high_price = price;
             }
+
+            MatchLevel(price_nodes_[idx], level_sizes_[idx], order_node, cross_price, idx);
         }
         else
         {
@@ -87,12 +195,31 @@ void Depth::Match(OrderNode &order_node)
         if(order_node.size_ == 0) break;
     }
 
-    LOG_RAW_STDOUT("break consume on top:%d, idx:%d", top_, idx);
+    LOG_BOOK_TRACE("break consume on top:%d, idx:%d", top_, idx);
 
     ResetTop();
 }
 
-void Depth::Print()
+void ArrayDepth::PopCrossed(int32_t price, vector<OrderNode>& order_nodes)
+{
+    if(top_ < 0) { return; }
+
+    int elem_size = (bottom_ - top_ + current_size_) % current_size_;
+    for(int i = 0, idx = top_; i <= elem_size; i++, idx = (idx + 1) % current_size_)
+    {
+        if(price_nodes_[idx] == NULL) { continue; }
+        if(!IsCrossed(price_nodes_[idx]->value_.price_, price))
+        {
+            break;
+        }
+
+        PopLevel(price_nodes_[idx], level_sizes_[idx], order_nodes, idx);
+    }
+
+    ResetTop();
+}
+
+void ArrayDepth::Print()
 {
     printf("%s order with top:%d, bottom:%d, current_size:%d\n",
            order_type_desc[type_], top_, bottom_, current_size_);
@@ -105,24 +232,16 @@ void Depth::Print()
     for(int i = 0, idx = top_; i <= elem_size; i++, idx = (idx + 1) % current_size_)
     {
         if(price_nodes_[idx] == NULL) { continue; }
-        LinkNode<OrderNode>* node = price_nodes_[idx];
-        printf("%d(%d): ", node->value_.price_, idx);
-        while(node)
-        {
-            assert(price_nodes_[idx]->value_.price_ == node->value_.price_);
-            printf("%d(%s) ", node->value_.size_, node->value_.id_.c_str());
-            node = node->next_;
-        }
-        printf("\n");
+        PrintLevel(price_nodes_[idx], idx);
     }
 }
 
-void Depth::Add(OrderNode &order_node)
+void ArrayDepth::Add(OrderNode &order_node)
 {
     if(top_ == -1)
     {
         top_ = bottom_ = 0;
-        AddLinkNode(top_, order_node);
+        AddLinkNode(price_nodes_[top_], level_sizes_[top_], order_node, top_);
         return;
     }
 
@@ -145,8 +264,9 @@ void Depth::Add(OrderNode &order_node)
     if(require_size >= current_size_)
     {
         int enlarge_size = require_size / step_size_ * step_size_ + step_size_ - current_size_;
-        LOG_RAW_STDOUT("enlarge array by %d", enlarge_size);
+        LOG_BOOK_TRACE("enlarge array by %d", enlarge_size);
         LinkNode<OrderNode>** tmp = CreateLinkNodeArray(current_size_ + enlarge_size);
+        int64_t* tmp_sizes = CreateLevelSizeArray(current_size_ + enlarge_size);
 
         // copy old nodes
         int new_top_price = price_nodes_[top_]->value_.price_;
@@ -157,21 +277,24 @@ void Depth::Add(OrderNode &order_node)
             if(price_nodes_[idx] == NULL) { continue; }
             int new_index  = (price_nodes_[idx]->value_.price_ - new_top_price) * index_step_ / tick_price_;
             tmp[new_index] = price_nodes_[idx];
+            tmp_sizes[new_index] = level_sizes_[idx];
             bottom_        = new_index;
         }
 
-        delete []price_nodes_;
+        PolicyFree(price_nodes_);
+        PolicyFree(level_sizes_);
         price_nodes_   = tmp;
+        level_sizes_   = tmp_sizes;
         top_           = 0;
         current_size_ += enlarge_size;
-        LOG_RAW_STDOUT("reset current %s top:%d, bottom:%d", order_type_desc[type_], top_, bottom_);
+        LOG_BOOK_TRACE("reset current %s top:%d, bottom:%d", order_type_desc[type_], top_, bottom_);
 
         Add(order_node);
     }
     else
     {
         int idx = GetIndexByPrice(order_node.price_);
-        AddLinkNode(idx, order_node);
+        AddLinkNode(price_nodes_[idx], level_sizes_[idx], order_node, idx);
         if(type_ == OrderType_Ask)
         {
             if(order_node.price_ < price_nodes_[top_]->value_.price_)
@@ -194,11 +317,11 @@ void Depth::Add(OrderNode &order_node)
                 top_ = idx;
             }
         }
-        LOG_RAW_STDOUT("current %s top:%d, bottom:%d", order_type_desc[type_], top_, bottom_);
+        LOG_BOOK_TRACE("current %s top:%d, bottom:%d", order_type_desc[type_], top_, bottom_);
     }
 }
 
-void Depth::Clear()
+void ArrayDepth::Clear()
 {
     if(top_ == -1) { return; }
 
@@ -218,8 +341,9 @@ void Depth::Clear()
 
         if(price_nodes_[i] != NULL)
         {
-            LOG_RAW_STDOUT("clear %s price:%d", order_type_desc[type_], price_nodes_[i]->value_.price_);
+            LOG_BOOK_TRACE("clear %s price:%d", order_type_desc[type_], price_nodes_[i]->value_.price_);
             ClearLinkList(price_nodes_[i]);
+            level_sizes_[i] = 0;
         }
     }
 
@@ -227,20 +351,7 @@ void Depth::Clear()
     map_link_nodes_.clear();
 }
 
-void Depth::AddLinkNode(int idx, const OrderNode &order_node)
-{
-    LOG_RAW_STDOUT("add price:%d into %s idx:%d", order_node.price_, order_type_desc[type_], idx);
-    auto ret = InsertSortLinkList(price_nodes_[idx], order_node, false, order_id_less_func_);
-    if(ret.first == false)
-    {
-        LOG_RAW_STDOUT("ignore order node with same id:%s", order_node.id_.c_str());
-        return;
-    }
-
-    map_link_nodes_[order_node.id_] = ret.second;
-}
-
-void Depth::ResetTop()
+void ArrayDepth::ResetTop()
 {
     // search next non-empty price node since top_
     int i = 0, idx = top_;
@@ -259,7 +370,7 @@ void Depth::ResetTop()
     }
 }
 
-void Depth::ResetBottom()
+void ArrayDepth::ResetBottom()
 {
     // search previous non-empty price node since bottom_
     int i = 0, idx = bottom_;
@@ -278,21 +389,19 @@ void Depth::ResetBottom()
     }
 }
 
-void Depth::DeleteOrder(OrderNode &order_node)
+void ArrayDepth::DeleteOrder(OrderNode &order_node)
 {
     auto iter = map_link_nodes_.find(order_node.id_);
     if(iter == map_link_nodes_.end())
     {
-        LOG_RAW_STDOUT("missing %s with order id:%s", order_type_desc[type_], order_node.id_.c_str());
+        LOG_BOOK_TRACE("missing %s with order id:%s", order_type_desc[type_], order_node.id_.c_str());
         return;
     }
 
-    LinkNode<OrderNode>* link_node = iter->second;
-    int idx = GetIndexByPrice(link_node->value_.price_);
-    LOG_RAW_STDOUT("clear %s order node at index:%d", order_type_desc[type_], idx);
+    int idx = GetIndexByPrice(iter->second->value_.price_);
+    LOG_BOOK_TRACE("clear %s order node at index:%d", order_type_desc[type_], idx);
 
-    RemoveLinkNode(price_nodes_[idx], link_node);
-    map_link_nodes_.erase(iter);
+    RemoveOrder(price_nodes_[idx], level_sizes_[idx], iter);
 
     /*
      * adjust top_ & bottom_ if necessary
@@ -307,14 +416,54 @@ void Depth::DeleteOrder(OrderNode &order_node)
     }
 }
 
-int Depth::GetIndexByPrice(int32_t price)
+bool ArrayDepth::GetTopPrice(int32_t &price)
+{
+    if(top_ == -1) { return false; }
+
+    price = price_nodes_[top_]->value_.price_;
+    return true;
+}
+
+void ArrayDepth::CopyLevelSizes(int count, int64_t* sizes)
+{
+    if(top_ == -1)
+    {
+        memset(sizes, 0, sizeof(int64_t) * count);
+        return;
+    }
+
+    //
+    // slots beyond current_size_ would wrap around to top_ again
+    //
+    int copy_size = std::min(count, current_size_);
+    int head_size = std::min(copy_size, current_size_ - top_);
+    memcpy(sizes, level_sizes_ + top_, sizeof(int64_t) * head_size);
+    memcpy(sizes + head_size, level_sizes_, sizeof(int64_t) * (copy_size - head_size));
+    memset(sizes + copy_size, 0, sizeof(int64_t) * (count - copy_size));
+}
+
+void ArrayDepth::CopyLevels(int32_t price, vector<LevelSize>& levels)
+{
+    if(top_ == -1) { return; }
+
+    int elem_size = (bottom_ - top_ + current_size_) % current_size_;
+    for(int i = 0, idx = top_; i <= elem_size; i++, idx = (idx + 1) % current_size_)
+    {
+        if(price_nodes_[idx] == NULL) { continue; }
+        if(!IsCrossed(price_nodes_[idx]->value_.price_, price)) { break; }
+
+        levels.push_back(LevelSize(price_nodes_[idx]->value_.price_, level_sizes_[idx]));
+    }
+}
+
+int ArrayDepth::GetIndexByPrice(int32_t price)
 {
     int offset_top = (price - price_nodes_[top_]->value_.price_) / tick_price_;
     int idx = (top_ + offset_top * index_step_ + current_size_) % current_size_;
     return idx;
 }
 
-void Depth::ResetTickPrice(int32_t price)
+void ArrayDepth::ResetTickPrice(int32_t price)
 {
     if(top_ == -1)  // it's safe to change tick price if current no OrderNode
     {
@@ -326,6 +475,7 @@ void Depth::ResetTickPrice(int32_t price)
     int multiplies = tick_price_ / price;
 
     LinkNode<OrderNode>** tmp = CreateLinkNodeArray(multiplies * current_size_);
+    int64_t* tmp_sizes = CreateLevelSizeArray(multiplies * current_size_);
 
     int elem_size = (bottom_ - top_ + current_size_) % current_size_;
     for(int i = 0, idx = top_; i <= elem_size; i++, idx = (idx + 1) % current_size_)
@@ -333,66 +483,447 @@ void Depth::ResetTickPrice(int32_t price)
         if(price_nodes_[idx] == NULL) { continue; }
         int new_index  = multiplies * idx;
         tmp[new_index] = price_nodes_[idx];
+        tmp_sizes[new_index] = level_sizes_[idx];
     }
 
-    delete []price_nodes_;
+    PolicyFree(price_nodes_);
+    PolicyFree(level_sizes_);
     price_nodes_   = tmp;
+    level_sizes_   = tmp_sizes;
     top_          *= multiplies;
     bottom_       *= multiplies;
     current_size_ *= multiplies;
-    LOG_RAW_STDOUT("reset %s with top:%d, bottom:%d, size:%d when reset tick price from %d to %d",
+    LOG_BOOK_TRACE("reset %s with top:%d, bottom:%d, size:%d when reset tick price from %d to %d",
                 order_type_desc[type_], top_, bottom_, current_size_, tick_price_, price);
     tick_price_    = price;
 }
 
-LinkNode<OrderNode>** Depth::CreateLinkNodeArray(int size)
+LinkNode<OrderNode>** ArrayDepth::CreateLinkNodeArray(int size)
+{
+    // regions from PolicyAlloc are zeroed, i.e. all NULL
+    return (LinkNode<OrderNode>**)PolicyAlloc(sizeof(LinkNode<OrderNode>*) * size, policy_);
+}
+
+int64_t* ArrayDepth::CreateLevelSizeArray(int size)
+{
+    return (int64_t*)PolicyAlloc(sizeof(int64_t) * size, policy_);
+}
+
+LevelContainer ChooseLevelContainer(const LevelConfig& level_config)
+{
+    if(level_config.container_ != LevelContainer_Auto)
+    {
+        return level_config.container_;
+    }
+
+    //
+    // a ring array slot costs 16 bytes, so 64k ticks stay within 1MB; wider
+    // ranges pay off only if enough of their ticks hold orders. In level_bench
+    // array still wins at 1/20 of ticks holding orders and map at 1/1000
+    //
+    int64_t range  = level_config.price_range_;
+    int64_t levels = level_config.active_levels_;
+    if(range <= 65536 || levels * 32 >= range)
+    {
+        return LevelContainer_Array;
+    }
+
+    if(levels > 0 && levels * 256 < range)
+    {
+        return LevelContainer_Map;
+    }
+
+    return LevelContainer_Hybrid;
+}
+
+Depth* CreateDepth(int type,
+                   int tick_price,
+                   OrderIdLessFunc order_id_less_func,
+                   int initial_size,
+                   int step_size,
+                   const AllocPolicy& policy,
+                   const LevelConfig& level_config
+)
+{
+    switch(ChooseLevelContainer(level_config))
+    {
+    case LevelContainer_Map:
+        return new MapDepth(type, tick_price, order_id_less_func, policy);
+    case LevelContainer_Hybrid:
+        {
+            // an empty window would keep every level in overflow and never match
+            int window_size = level_config.window_size_;
+            if(window_size < kMinWindowSize)
+            {
+                LOG_ERROR("invalid hybrid window size:%d, use %d instead", window_size, kMinWindowSize);
+                window_size = kMinWindowSize;
+            }
+            return new HybridDepth(window_size, type, tick_price, order_id_less_func, policy);
+        }
+    default:
+        // ArrayDepth takes step_size before initial_size, OrderBook used to pass them swapped
+        return new ArrayDepth(type == OrderType_Ask ? 1 : -1, step_size, initial_size,
+                              type, tick_price, order_id_less_func, policy);
+    }
+}
+
+StopBook::StopBook(int32_t tick_price, OrderIdLessFunc order_id_less_func, int initial_size, int step_size,
+                   const AllocPolicy& policy, const LevelConfig& level_config)
+    : buy_stops_(CreateDepth(OrderType_Ask, tick_price, order_id_less_func, initial_size, step_size,
+                             policy, level_config)),
+    sell_stops_(CreateDepth(OrderType_Bid, tick_price, order_id_less_func, initial_size, step_size,
+                            policy, level_config))
+{
+
+}
+
+StopBook::~StopBook()
+{
+    delete buy_stops_;
+    delete sell_stops_;
+}
+
+void StopBook::Add(const OrderNode &order_node)
+{
+    OrderNode stop_node = order_node;
+    SwapStopPrice(stop_node);
+    Depth* depth = (order_node.type_ == OrderType_Bid ? buy_stops_ : sell_stops_);
+    depth->Add(stop_node);
+}
+
+bool StopBook::DeleteOrder(OrderNode &order_node)
+{
+    Depth* depth = (order_node.type_ == OrderType_Bid ? buy_stops_ : sell_stops_);
+    if(!depth->HasOrder(order_node.id_))
+    {
+        return false;
+    }
+
+    depth->DeleteOrder(order_node);
+    return true;
+}
+
+bool StopBook::HasOrder(const string& id)
+{
+    return buy_stops_->HasOrder(id) || sell_stops_->HasOrder(id);
+}
+
+void StopBook::Trigger(int32_t low_price, int32_t high_price, deque<OrderNode> &triggered)
 {
-    auto array = new LinkNode<OrderNode>*[size];
-    for(int i = 0; i < size; i++)
+    vector<OrderNode> order_nodes;
+    buy_stops_->PopCrossed(high_price, order_nodes);
+    sell_stops_->PopCrossed(low_price, order_nodes);
+
+    for(auto& order_node : order_nodes)
     {
-        array[i] = NULL;
+        SwapStopPrice(order_node);
+        order_node.kind_ = (order_node.kind_ == OrderKind_Stop ? OrderKind_Market : OrderKind_Limit);
+        LOG_BOOK_TRACE("trigger stop order id:%s with stop price:%d", order_node.id_.c_str(), order_node.stop_price_);
+        triggered.push_back(order_node);
     }
+}
 
-    return array;
+void StopBook::Print()
+{
+    printf("buy stop ");
+    buy_stops_->Print();
+    printf("sell stop ");
+    sell_stops_->Print();
+}
+
+void StopBook::Clear()
+{
+    buy_stops_->Clear();
+    sell_stops_->Clear();
+}
+
+void StopBook::ResetTickPrice(int32_t price)
+{
+    buy_stops_->ResetTickPrice(price);
+    sell_stops_->ResetTickPrice(price);
+}
+
+void StopBook::SwapStopPrice(OrderNode &order_node)
+{
+    std::swap(order_node.price_, order_node.stop_price_);
 }
 
-OrderBook::OrderBook(int32_t tick_price, OrderIdLessFunc order_id_less_func, int initial_size, int step_size)
+OrderBook::OrderBook(int32_t tick_price, OrderIdLessFunc order_id_less_func, int initial_size, int step_size,
+                     const AllocPolicy& policy, const LevelConfig& level_config)
     : tick_price_(tick_price),
-    ask_(1, initial_size, step_size, OrderType_Ask, tick_price, order_id_less_func),
-    bid_(-1, initial_size, step_size, OrderType_Bid, tick_price, order_id_less_func)
+    ask_(CreateDepth(OrderType_Ask, tick_price, order_id_less_func, initial_size, step_size, policy, level_config)),
+    bid_(CreateDepth(OrderType_Bid, tick_price, order_id_less_func, initial_size, step_size, policy, level_config)),
+    stops_(tick_price, order_id_less_func, initial_size, step_size, policy, level_config),
+    dense_levels_(ChooseLevelContainer(level_config) == LevelContainer_Array)
 {
 
 }
 
-void OrderBook::AddOrder(OrderNode order_node)
+OrderBook::~OrderBook()
 {
+    delete ask_;
+    delete bid_;
+}
+
+bool OrderBook::AddOrder(OrderNode order_node)
+{
+    if(order_node.kind_ == OrderKind_Stop || order_node.kind_ == OrderKind_StopLimit)
+    {
+        // stops wait in auction mode until Uncross fires them
+        if(auction_mode_ || !IsStopTriggered(order_node))
+        {
+            stops_.Add(order_node);
+            return true;
+        }
+        order_node.kind_ = (order_node.kind_ == OrderKind_Stop ? OrderKind_Market : OrderKind_Limit);
+    }
+
+    if(auction_mode_)
+    {
+        if(order_node.kind_ == OrderKind_Market)
+        {
+            LOG_ERROR("reject market order id:%s in auction mode", order_node.id_.c_str());
+            return false;
+        }
+
+        Depth* same_depth = (order_node.type_ == OrderType_Ask ? ask_ : bid_);
+        same_depth->Add(order_node);
+    }
+    else
+    {
+        MatchOrder(order_node);
+    }
+
+    DrainTriggeredStops();
+    PublishQuote();
+
+    return true;
+}
+
+void OrderBook::DrainTriggeredStops()
+{
+    //
+    // stops triggered by nested AddOrder are appended to the same queue, so
+    // cascades are injected breadth first in trigger order
+    //
+    if(draining_stops_) { return; }
+    draining_stops_ = true;
+    while(!triggered_stops_.empty())
+    {
+        OrderNode stop_node = triggered_stops_.front();
+        triggered_stops_.pop_front();
+        AddOrder(stop_node);
+    }
+    draining_stops_ = false;
+}
+
+void OrderBook::MatchOrder(OrderNode &order_node)
+{
+    int32_t limit_price = order_node.price_;
+    if(order_node.kind_ == OrderKind_Market)
+    {
+        order_node.price_ = (order_node.type_ == OrderType_Ask ? INT32_MIN : INT32_MAX);
+    }
+
     // match opposite depth first before adding
-    Depth* matched_depth = (order_node.type_ == OrderType_Ask ? &bid_ : &ask_);
-    matched_depth->Match(order_node);
+    int32_t low_price = 0, high_price = 0;
+    Depth* matched_depth = (order_node.type_ == OrderType_Ask ? bid_ : ask_);
+    matched_depth->Match(order_node, &low_price, &high_price);
+    order_node.price_ = limit_price;
+
+    if(high_price != 0)
+    {
+        last_price_ = (order_node.type_ == OrderType_Ask ? low_price : high_price);
+        stops_.Trigger(low_price, high_price, triggered_stops_);
+    }
 
     if(order_node.size_ > 0)
     {
-        Depth* same_depth = (order_node.type_ == OrderType_Ask ? &ask_ : &bid_);
+        if(order_node.kind_ == OrderKind_Market)
+        {
+            LOG_BOOK_TRACE("drop unfilled market order id:%s with size:%d", order_node.id_.c_str(), order_node.size_);
+            return;
+        }
+
+        Depth* same_depth = (order_node.type_ == OrderType_Ask ? ask_ : bid_);
         same_depth->Add(order_node);
     }
 }
 
+bool OrderBook::IsStopTriggered(const OrderNode &order_node)
+{
+    if(last_price_ == 0) { return false; }
+
+    return (order_node.type_ == OrderType_Bid && last_price_ >= order_node.stop_price_)
+        || (order_node.type_ == OrderType_Ask && last_price_ <= order_node.stop_price_);
+}
+
+void OrderBook::SetFillListener(FillListener* fill_listener)
+{
+    ask_->SetFillListener(fill_listener);
+    bid_->SetFillListener(fill_listener);
+}
+
+void OrderBook::SetAnalytics(TradeAnalytics* analytics)
+{
+    analytics_ = analytics;
+    ask_->SetAnalytics(analytics);
+    bid_->SetAnalytics(analytics);
+    PublishQuote();
+}
+
+void OrderBook::PublishQuote()
+{
+    if(analytics_ == NULL) { return; }
+
+    // book may be crossed while orders accumulate for call auction, so no
+    // quote is valid and auction time is left out of time weighted prices
+    int32_t bid_price = 0, ask_price = 0;
+    if(!auction_mode_)
+    {
+        bid_->GetTopPrice(bid_price);
+        ask_->GetTopPrice(ask_price);
+    }
+    analytics_->OnQuote(bid_price, ask_price);
+}
+
+void OrderBook::SetAuctionMode(bool auction_mode)
+{
+    auction_mode_ = auction_mode;
+    PublishQuote();
+}
+
+int64_t OrderBook::Uncross()
+{
+    //
+    // leave auction mode first, stops triggered by the auction print must
+    // match continuously instead of being rejected or resting crossed
+    //
+    auction_mode_ = false;
+
+    //
+    // stops parked during auction may be met by the last price before it
+    // as well as by the auction price, other stops are met by neither
+    //
+    int32_t last_price = last_price_;
+    int64_t volume = ExecuteAuction();
+    if(last_price_ != 0)
+    {
+        int32_t low_price  = (last_price != 0 ? std::min(last_price, last_price_) : last_price_);
+        int32_t high_price = (last_price != 0 ? std::max(last_price, last_price_) : last_price_);
+        stops_.Trigger(low_price, high_price, triggered_stops_);
+    }
+    DrainTriggeredStops();
+    PublishQuote();
+
+    return volume;
+}
+
+int64_t OrderBook::ExecuteAuction()
+{
+    int32_t ask_price = 0, bid_price = 0;
+    if(!ask_->GetTopPrice(ask_price) || !bid_->GetTopPrice(bid_price) || bid_price < ask_price)
+    {
+        LOG_BOOK_TRACE("book not crossed, nothing to uncross");
+        return 0;
+    }
+
+    //
+    // only levels within [best ask, best bid] can trade. Ring arrays take
+    // them as dense arrays of sizes, one tick each. Sparse containers take
+    // non-empty levels only, as the range may span millions of ticks
+    //
+    int32_t price  = 0;
+    int64_t volume = 0;
+    if(dense_levels_)
+    {
+        int count = (bid_price - ask_price) / tick_price_ + 1;
+        auction_ask_sizes_.resize(count);
+        auction_bid_sizes_.resize(count);
+        ask_->CopyLevelSizes(count, auction_ask_sizes_.data());
+        bid_->CopyLevelSizes(count, auction_bid_sizes_.data());
+
+        int preferred = (count - 1) / 2;
+        if(last_price_ != 0)
+        {
+            preferred = std::max(0, std::min(count - 1, (last_price_ - ask_price) / tick_price_));
+        }
+
+        int k = SearchEquilibrium(auction_ask_sizes_.data(), auction_bid_sizes_.data(), count, preferred, volume);
+        if(k < 0) { return 0; }
+        price = ask_price + k * tick_price_;
+    }
+    else
+    {
+        auction_ask_levels_.clear();
+        auction_bid_levels_.clear();
+        ask_->CopyLevels(bid_price, auction_ask_levels_);
+        bid_->CopyLevels(ask_price, auction_bid_levels_);
+
+        // same reference price as dense path, snapped to tick grid of best ask
+        int32_t preferred_price = ask_price + (bid_price - ask_price) / tick_price_ / 2 * tick_price_;
+        if(last_price_ != 0)
+        {
+            int32_t reference = std::max(ask_price, std::min(bid_price, last_price_));
+            preferred_price = ask_price + (reference - ask_price) / tick_price_ * tick_price_;
+        }
+
+        price = SearchSparseEquilibrium(auction_ask_levels_, auction_bid_levels_, tick_price_, preferred_price, volume);
+        if(price == 0) { return 0; }
+    }
+
+    LOG_BOOK_TRACE("uncross at price:%d with volume:%lld", price, (long long)volume);
+
+    //
+    // both sides fill volume in their own price & order id priority. Each
+    // auction trade shows up on both sides, so feed analytics from ask only
+    //
+    bid_->SetAnalytics(NULL);
+    for(int64_t left = volume; left > 0; )
+    {
+        int32_t size = (int32_t)std::min<int64_t>(left, INT32_MAX);
+        OrderNode buy_node(price, "", size, OrderType_Bid);
+        OrderNode sell_node(price, "", size, OrderType_Ask);
+        ask_->Match(buy_node, NULL, NULL, price);
+        bid_->Match(sell_node, NULL, NULL, price);
+        left -= size;
+    }
+    bid_->SetAnalytics(analytics_);
+
+    last_price_ = price;
+    return volume;
+}
+
 void OrderBook::DeleteOrder(OrderNode &order_node)
 {
-    Depth* matched_depth = (order_node.type_ == OrderType_Ask ? &ask_ : &bid_);
+    if(stops_.DeleteOrder(order_node))
+    {
+        return;
+    }
+
+    Depth* matched_depth = (order_node.type_ == OrderType_Ask ? ask_ : bid_);
     matched_depth->DeleteOrder(order_node);
+    PublishQuote();
+}
+
+bool OrderBook::HasOrder(const string& id)
+{
+    return ask_->HasOrder(id) || bid_->HasOrder(id) || stops_.HasOrder(id);
 }
 
 void OrderBook::Print()
 {
-    ask_.Print();
-    bid_.Print();
+    ask_->Print();
+    bid_->Print();
+    stops_.Print();
 }
 
 void OrderBook::Clear()
 {
-    ask_.Clear();
-    bid_.Clear();
+    ask_->Clear();
+    bid_->Clear();
+    stops_.Clear();
+    PublishQuote();
 }
 
 void OrderBook::ResetTickPrice(int32_t price)
@@ -414,6 +945,8 @@ void OrderBook::ResetTickPrice(int32_t price)
         return;
     }
 
-    ask_.ResetTickPrice(price);
-    bid_.ResetTickPrice(price);
+    ask_->ResetTickPrice(price);
+    bid_->ResetTickPrice(price);
+    stops_.ResetTickPrice(price);
+    tick_price_ = price;
 }
@@ -6,10 +6,27 @@
 #pragma once
 
 #include <string>
+#include <deque>
+#include <vector>
 using namespace std;
 
 #include "expr/iscaswang/comm/ds/double_list.h"
 #include "../orderbook/commdef.h"
+#include "alloc_policy.h"
+#include "auction.h"
+#include "trade_analytics.h"
+
+//
+// execution kind of each order. Stop orders rest in StopBook until a trade
+// crosses stop_price_, then turn into market or limit orders respectively.
+//
+enum OrderKind
+{
+    OrderKind_Limit     = 0,
+    OrderKind_Market    = 1,
+    OrderKind_Stop      = 2,
+    OrderKind_StopLimit = 3,
+};
 
 //
 // basic info for each order
@@ -20,6 +37,8 @@ typedef struct OrderNode
     string  id_;
     int32_t size_  = 0;
     OrderType type_= OrderType_Min_Invalid;
+    OrderKind kind_= OrderKind_Limit;
+    int32_t stop_price_ = 0;    // trigger price, only valid for stop orders
 
     bool operator==(const OrderNode& t) const
     {
@@ -37,54 +56,215 @@ typedef bool (*OrderIdLessFunc)(const OrderNode& a, const OrderNode& b);
 bool OrderIdLessString(const OrderNode& a, const OrderNode& b);
 bool OrderIdLessInteger(const OrderNode& a, const OrderNode& b);
 
+//
+// per operation trace of books & depths, on by default. Turn it off where
+// formatting each operation would dominate, e.g. in benchmarks
+//
+extern bool orderbook_trace;
+
+#define LOG_BOOK_TRACE(fmt, ...) \
+    do { if(orderbook_trace) { LOG_RAW_STDOUT(fmt, ##__VA_ARGS__); } } while(0)
+
+//
+// receives every fill in Depth::Match. resting & incoming hold the sizes
+// before the fill. Called inside matching, so it must not modify the book
+//
+class FillListener
+{
+public:
+    virtual ~FillListener() {}
+
+    virtual void OnFill(const OrderNode& resting, const OrderNode& incoming, int32_t price, int32_t size) = 0;
+};
+
+//
+// container of price levels, ask or bid. Implementations differ in how
+// price levels are stored, see LevelContainer
+//
 class Depth
 {
 public:
-    Depth(int index_step,
-          int step_size,
-          int initial_size,
-          int type,
+    Depth(int type,
           int tick_price,
-          OrderIdLessFunc order_id_less_func
+          OrderIdLessFunc order_id_less_func,
+          const AllocPolicy& policy = AllocPolicy()
     );
 
-    ~Depth();
+    virtual ~Depth() {}
 
     /*
      * match order node by price & size. Modify order_node with values
-     * after match
+     * after match. low_price & high_price, if given, should be initialized
+     * to 0 and receive the price range of fills, left 0 if nothing matched.
+     * All fills execute at cross_price unless it is 0, e.g. in call auction
      */
-    void Match(OrderNode& order_node);
+    virtual void Match(OrderNode& order_node, int32_t* low_price = NULL, int32_t* high_price = NULL,
+                       int32_t cross_price = 0) = 0;
+
+    /*
+     * pop all order nodes on price levels crossed by price, in the same
+     * order Match would consume them
+     */
+    virtual void PopCrossed(int32_t price, vector<OrderNode>& order_nodes) = 0;
 
     /*
      * print current depth, including price and all nodes(size, id) of that price level
      */
-    void Print();
+    virtual void Print() = 0;
 
     /*
      * add one order node into depth
      */
-    void Add(OrderNode& order_node);
+    virtual void Add(OrderNode& order_node) = 0;
 
     /*
      * release all order nodes allocated in depth
      */
-    void Clear();
+    virtual void Clear() = 0;
 
     /*
      * delete order node from depth
      */
-    void DeleteOrder(OrderNode &order_node);
+    virtual void DeleteOrder(OrderNode &order_node) = 0;
 
     /*
-     * get the index in price array since top
+     * get price of top price node, return false if depth is empty
      */
-    inline int GetIndexByPrice(int32_t price);
+    virtual bool GetTopPrice(int32_t& price) = 0;
+
+    /*
+     * copy total size of count price levels since top, one tick each, into
+     * sizes. Levels without order node are filled with 0
+     */
+    virtual void CopyLevelSizes(int count, int64_t* sizes) = 0;
+
+    /*
+     * append total size of each non-empty level crossed by price into
+     * levels, in priority order. Cost follows levels, not ticks
+     */
+    virtual void CopyLevels(int32_t price, vector<LevelSize>& levels) = 0;
 
     /*
      * called only if new tick price is less than current tick price
      */
-    void ResetTickPrice(int32_t price);
+    virtual void ResetTickPrice(int32_t price) = 0;
+
+    /*
+     * set listener notified on each fill, NULL to disable
+     */
+    void SetFillListener(FillListener* fill_listener);
+
+    /*
+     * set analytics fed with each fill, NULL to disable
+     */
+    void SetAnalytics(TradeAnalytics* analytics);
+
+    /*
+     * check whether order with specified id rests in depth
+     */
+    bool HasOrder(const string& id);
+
+protected:
+    typedef PoolAllocator<pair<const string, LinkNode<OrderNode>*> > LinkNodeAllocator;
+    typedef map<string, LinkNode<OrderNode>*, less<string>, LinkNodeAllocator> LinkNodeMap;
+
+    /*
+     * key of price level in priority order, i.e. best level has least key
+     */
+    int32_t LevelKey(int32_t price)
+    {
+        return (type_ == OrderType_Ask ? price : -price);
+    }
+
+    /*
+     * whether price level at level_price is crossed by order at price
+     */
+    bool IsCrossed(int32_t level_price, int32_t price)
+    {
+        return (type_ == OrderType_Ask && level_price <= price)
+            || (type_ == OrderType_Bid && level_price >= price);
+    }
+
+    /*
+     * match order node against orders of one price level, idx is for logging
+     */
+    void MatchLevel(LinkNode<OrderNode>*& head, int64_t& level_size, OrderNode& order_node,
+                    int32_t cross_price, int idx);
+
+    /*
+     * pop all order nodes of one price level into order_nodes, idx is for logging
+     */
+    void PopLevel(LinkNode<OrderNode>*& head, int64_t& level_size, vector<OrderNode>& order_nodes, int idx);
+
+    /*
+     * add order node into one price level, idx is for logging
+     */
+    void AddLinkNode(LinkNode<OrderNode>*& head, int64_t& level_size, const OrderNode& order_node, int idx);
+
+    /*
+     * remove order node of iter from one price level
+     */
+    void RemoveOrder(LinkNode<OrderNode>*& head, int64_t& level_size, LinkNodeMap::iterator iter);
+
+    /*
+     * print order nodes of one price level, idx is for display
+     */
+    void PrintLevel(LinkNode<OrderNode>* head, int idx);
+
+    int type_         = 0;  // order type, ask or bid
+    int tick_price_   = 0;  // price for each tick
+
+    AllocPolicy                       policy_;      // for price levels & order_pool_
+    PolicyPool                        order_pool_;  // storage of map_link_nodes_
+    FillListener*                     fill_listener_ = NULL;
+    TradeAnalytics*                   analytics_     = NULL;
+    LinkNodeMap                       map_link_nodes_;
+    OrderIdLessFunc                   order_id_less_func_;
+};
+
+//
+// price levels in a ring array indexed by tick offset since top. Best for
+// dense & narrow price range
+//
+class ArrayDepth : public Depth
+{
+public:
+    ArrayDepth(int index_step,
+               int step_size,
+               int initial_size,
+               int type,
+               int tick_price,
+               OrderIdLessFunc order_id_less_func,
+               const AllocPolicy& policy = AllocPolicy()
+    );
+
+    virtual ~ArrayDepth();
+
+    virtual void Match(OrderNode& order_node, int32_t* low_price = NULL, int32_t* high_price = NULL,
+                       int32_t cross_price = 0);
+
+    virtual void PopCrossed(int32_t price, vector<OrderNode>& order_nodes);
+
+    virtual void Print();
+
+    virtual void Add(OrderNode& order_node);
+
+    virtual void Clear();
+
+    virtual void DeleteOrder(OrderNode &order_node);
+
+    virtual bool GetTopPrice(int32_t& price);
+
+    virtual void CopyLevelSizes(int count, int64_t* sizes);
+
+    virtual void CopyLevels(int32_t price, vector<LevelSize>& levels);
+
+    virtual void ResetTickPrice(int32_t price);
+
+    /*
+     * get the index in price array since top
+     */
+    inline int GetIndexByPrice(int32_t price);
 
 private:
     /*
@@ -93,9 +273,9 @@ private:
     LinkNode<OrderNode>** CreateLinkNodeArray(int size);
 
     /*
-     * add order node into depth with price node index idx
+     * create new zeroed level size array
      */
-    void AddLinkNode(int idx, const OrderNode& order_node);
+    int64_t* CreateLevelSizeArray(int size);
 
     /*
      * reset top index of price node in the array. Used after order matching
@@ -113,12 +293,111 @@ private:
     int current_size_ = 0;  // current array size of price_nodes_
     int index_step_   = 0;  // index increment step for each variable tick price
     int step_size_    = 0;  // increase step_size_ on capacity enlarge
-    int type_         = 0;  // order type, ask or bid
-    int tick_price_   = 0;  // price for each tick
 
     LinkNode<OrderNode>**             price_nodes_;
-    map<string, LinkNode<OrderNode>*> map_link_nodes_;
-    OrderIdLessFunc                   order_id_less_func_;
+    int64_t*                          level_sizes_; // total size of each price node, same index
+};
+
+//
+// choice of price level container for each symbol
+//
+enum LevelContainer
+{
+    LevelContainer_Auto   = 0,  // chosen by ChooseLevelContainer
+    LevelContainer_Array  = 1,  // ArrayDepth, ring array of all ticks in range
+    LevelContainer_Map    = 2,  // MapDepth, ordered map of non-empty levels
+    LevelContainer_Hybrid = 3,  // HybridDepth, array window near top & map beyond
+};
+
+typedef struct LevelConfig
+{
+    LevelContainer container_ = LevelContainer_Auto;
+    int price_range_   = 0;     // expected price range in ticks, 0 if unknown
+    int active_levels_ = 0;     // expected non-empty levels of each side
+    int window_size_   = 4096;  // ticks in array window of HybridDepth, at least 16
+
+    LevelConfig() {}
+    LevelConfig(LevelContainer container) : container_(container) {}
+} LevelConfig;
+
+/*
+ * pick container for LevelContainer_Auto by expected price range & levels:
+ * array for unknown, narrow or dense books, map for very sparse ones and
+ * hybrid in between
+ */
+LevelContainer ChooseLevelContainer(const LevelConfig& level_config);
+
+/*
+ * create depth of type with container of level_config
+ */
+Depth* CreateDepth(int type,
+                   int tick_price,
+                   OrderIdLessFunc order_id_less_func,
+                   int initial_size,
+                   int step_size,
+                   const AllocPolicy& policy,
+                   const LevelConfig& level_config
+);
+
+//
+// Stop orders resting off-book, keyed by stop price in Depth like orders.
+// Buy stops fire when a trade prints at or above stop price, so they are
+// kept with ask ordering(lowest stop first); sell stops are kept with bid
+// ordering.
+//
+class StopBook
+{
+public:
+    StopBook(int32_t tick_price,
+             OrderIdLessFunc order_id_less_func,
+             int initial_size,
+             int step_size,
+             const AllocPolicy& policy = AllocPolicy(),
+             const LevelConfig& level_config = LevelConfig()
+    );
+
+    ~StopBook();
+
+    /*
+     * add stop order, which is indexed by its stop price
+     */
+    void Add(const OrderNode& order_node);
+
+    /*
+     * delete stop order with specified id, return false if not found
+     */
+    bool DeleteOrder(OrderNode& order_node);
+
+    /*
+     * whether stop order with specified id is parked, on either side
+     */
+    bool HasOrder(const string& id);
+
+    /*
+     * pop stops triggered by trades within [low_price, high_price] and append
+     * them to triggered as market or limit orders. Buy stops come first
+     * by ascending stop price, then sell stops by descending stop price, ties
+     * by order id
+     */
+    void Trigger(int32_t low_price, int32_t high_price, deque<OrderNode>& triggered);
+
+    void Print();
+
+    void Clear();
+
+    void ResetTickPrice(int32_t price);
+
+private:
+    /*
+     * swap price_ & stop_price_, so that Depth indexes stop order by stop price
+     */
+    static void SwapStopPrice(OrderNode& order_node);
+
+    StopBook(const StopBook&);
+    StopBook& operator=(const StopBook&);
+
+    Depth* buy_stops_;
+    Depth* sell_stops_;
 };
 
 class OrderBook
@@ -129,23 +408,37 @@ public:
      * order_id_less_func: function for comparing OrderNode when sorting
      * initial_size: the initial array size for price nodes
      * step_size   : enlarge multiple step_size when more price nodes required
+     * policy      : huge page & numa policy for price node arrays and order storage
+     * level_config: price level container of this symbol
      */
     OrderBook(int32_t tick_price,
               OrderIdLessFunc order_id_less_func = OrderIdLessString,
               int initial_size = 1000,
-              int step_size = 1000
+              int step_size = 1000,
+              const AllocPolicy& policy = AllocPolicy(),
+              const LevelConfig& level_config = LevelConfig()
     );
 
+    ~OrderBook();
+
     /*
-     * add order with specified type
+     * add order with specified type. Stop orders are parked in stop book
+     * until triggered, or until Uncross in auction mode, and triggered
+     * stops are injected back here, in trigger order, including cascades.
+     * Return false if order is rejected, i.e. market order in auction mode
      */
-    void AddOrder(OrderNode order_node);
+    bool AddOrder(OrderNode order_node);
 
     /*
      * delete order with specified id
      */
     void DeleteOrder(OrderNode& order_node);
 
+    /*
+     * whether order with specified id rests in book or parks in stop book
+     */
+    bool HasOrder(const string& id);
+
     /*
      * print the whole order, including ask & bid
      */
@@ -162,8 +455,72 @@ public:
      */
     void ResetTickPrice(int32_t price);
 
+    /*
+     * set listener notified on each fill of ask & bid, NULL to disable
+     */
+    void SetFillListener(FillListener* fill_listener);
+
+    /*
+     * set analytics fed with each fill and best prices after each book
+     * change, NULL to disable
+     */
+    void SetAnalytics(TradeAnalytics* analytics);
+
+    /*
+     * in auction mode orders accumulate without matching until Uncross
+     */
+    void SetAuctionMode(bool auction_mode);
+
+    /*
+     * execute call auction at the equilibrium price maximizing executable
+     * volume and resume continuous matching. Return the executed volume,
+     * 0 if book is not crossed
+     */
+    int64_t Uncross();
+
 private:
+    /*
+     * match order against opposite depth and rest the remaining size.
+     * Stops triggered by the fills are queued in triggered_stops_
+     */
+    void MatchOrder(OrderNode& order_node);
+
+    /*
+     * fill crossed orders at the equilibrium price and update last price.
+     * Return the executed volume, 0 if book is not crossed
+     */
+    int64_t ExecuteAuction();
+
+    /*
+     * check whether stop order would fire on last trade price
+     */
+    bool IsStopTriggered(const OrderNode& order_node);
+
+    /*
+     * inject queued triggered stops back through AddOrder
+     */
+    void DrainTriggeredStops();
+
+    /*
+     * feed best prices into analytics
+     */
+    void PublishQuote();
+
+    OrderBook(const OrderBook&);
+    OrderBook& operator=(const OrderBook&);
+
     int32_t tick_price_;
-    Depth ask_;
-    Depth bid_;
+    int32_t last_price_ = 0;    // price of last trade, 0 if no trade yet
+    bool    draining_stops_ = false;
+    bool    auction_mode_   = false;
+    TradeAnalytics* analytics_ = NULL;
+    Depth*  ask_;
+    Depth*  bid_;
+    StopBook stops_;
+    deque<OrderNode> triggered_stops_;
+    bool    dense_levels_;      // ArrayDepth, uncross over dense tick arrays
+    vector<int64_t>  auction_ask_sizes_;    // reused buffers for Uncross
+    vector<int64_t>  auction_bid_sizes_;
+    vector<LevelSize> auction_ask_levels_;
+    vector<LevelSize> auction_bid_levels_;
 };
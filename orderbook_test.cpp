@@ -7,6 +7,7 @@ using namespace std;
 #include "comm/kit/cmdline_parser.h"
 
 #include "orderbook.h"
+#include "order_decoder.h"
 
 int initial_order_id   = -1;
 int current_tick_price = 1;
@@ -19,7 +20,10 @@ void Help(int argc, char* argv[])
                     "-f file: the initial command file to load, useful for replay test\n"
                     "-c comp: the comparator for order id, support int & string only, default int\n"
                     "-t tick_price: the initial tick price, default 1\n"
-                    "-o order_id: the start of auto-generated order id\n" ,
+                    "-o order_id: the start of auto-generated order id\n"
+                    "-a interval_ms: enable trade analytics with bars of interval_ms\n"
+                    "-l container: the price level container, support array, map & hybrid, default array\n"
+                    "-w window_size: the array window in ticks of hybrid container, at least 16, default 4096\n" ,
                     argv[0]);
     exit(0);
 }
@@ -43,68 +47,38 @@ int GetOrderType(string& order_type, OrderType& type)
 
 void BuildOrderBookFromFile(OrderBook& book, const char* file)
 {
-    ifstream ifs(file, ios::in);
+    ifstream ifs(file, ios::in | ios::binary);
     if(!ifs.is_open())
     {
         LOG_ERROR("open quote filename:%s failed", file);
         return ;
     }
 
-    string line;
-    while(std::getline(ifs, line))
-    {
-        if(ifs.eof())
-        {
-            break;
-        }
-
-        line = CommUtil::LTrim(line);
-        if((line[0] == '#') || (line.length() == 0))
-        {
-            continue;
-        }
-
-        vector<string> parts;
-        CommUtil::SepString(line, ",", parts);
-        if(parts.size() != 5)
-        {
-            LOG_ERROR("ignore line(%s) with fields:%zu", line.c_str(), parts.size());
-            continue;
-        }
+    // load whole file and tokenize it in place
+    string content((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    ifs.close();
 
-        //LOG_DEBUG("line:%s", line.c_str());
+    vector<OrderCommand> commands;
+    ParseTextOrders(content.data(), content.size(), commands, true);
 
-        OrderNode info;
-        int ret = GetOrderType(parts[2], info.type_);
-        if(ret != 0)
+    OrderNode order_node;
+    for(auto& command : commands)
+    {
+        printf("\nRunning: %c,%.*s,%c,%d,%d", command.action_, (int)command.id_len_, command.id_,
+               command.type_ == OrderType_Ask ? 'S' : 'B', command.size_, command.price_);
+        if(command.kind_ == OrderKind_Stop || command.kind_ == OrderKind_StopLimit)
         {
-            LOG_ERROR("invalid type:%s for line:%s", parts[2].c_str(), line.c_str());
-            continue;
+            printf(",%d", command.stop_price_);
         }
+        printf("\n");
 
-        info.id_ = parts[1];
-        info.size_ = CommUtil::StrToUInt(parts[3]);
-        info.price_ = CommUtil::StrToUInt(parts[4]);
-
-        cout << endl << "Running: " << line << endl;
-
-        switch(parts[0][0])
-        {
-            case 'A': book.AddOrder(info); break;
-            case 'X': book.DeleteOrder(info); break;
-            case 'T': book.ResetTickPrice(info.price_); break;
-            default:
-                LOG_ERROR("invalid action:%s", parts[0].c_str());
-                continue;
-        }
+        ApplyOrderCommand(book, command, order_node);
 
         /*
          * Print order book after each operation for debugging
          */
         book.Print();
     }
-
-    ifs.close();
 }
 
 void ReadItem(const char* output, string& input)
@@ -134,7 +108,7 @@ void ReadFromStdin(OrderBook& book, int size)
     while(true)
     {
         string order_action;
-        ReadItem("select action[A,X,T,Q(quit)]", order_action);
+        ReadItem("select action[A,X,T,C(call auction),U(uncross),Q(quit)]", order_action);
         if(order_action[0] == 'Q' || order_action[0] == 'q')
         {
             break;
@@ -181,6 +155,14 @@ void ReadFromStdin(OrderBook& book, int size)
                 }
                 break;
 
+            case 'C':   // enter call auction
+                book.SetAuctionMode(true);
+                break;
+
+            case 'U':   // uncross call auction and resume continuous matching
+                cout << "uncross volume: " << book.Uncross() << endl;
+                break;
+
             default:
                 break;
         }
@@ -194,7 +176,7 @@ void ReadFromStdin(OrderBook& book, int size)
 
 int main(int argc, char* argv[])
 {
-    CommUtil::CmdLineParser parser("s:f:hc:o:t:");
+    CommUtil::CmdLineParser parser("s:f:hc:o:t:a:l:w:");
     parser.Parse(argc, argv);
     if(parser.Has('h'))
     {
@@ -211,7 +193,32 @@ int main(int argc, char* argv[])
     {
         current_tick_price = CommUtil::StrToInt(parser.Get('t'));
     }
-    OrderBook book(current_tick_price, less_func, 10, 10);
+    static map<string, LevelContainer> map_level_container = {
+            {"array",  LevelContainer_Array},
+            {"map",    LevelContainer_Map},
+            {"hybrid", LevelContainer_Hybrid},
+    };
+    LevelConfig level_config(LevelContainer_Array);
+    if(parser.Has('l'))
+    {
+        if(map_level_container.find(parser.Get('l')) == map_level_container.end())
+        {
+            LOG_ERROR("invalid level container:%s", parser.Get('l'));
+            Help(argc, argv);
+        }
+        level_config.container_ = map_level_container[parser.Get('l')];
+    }
+    if(parser.Has('w'))
+    {
+        level_config.window_size_ = CommUtil::StrToInt(parser.Get('w'));
+    }
+    OrderBook book(current_tick_price, less_func, 10, 10, AllocPolicy(), level_config);
+    TradeAnalytics* analytics = NULL;
+    if(parser.Has('a'))
+    {
+        analytics = new TradeAnalytics(CommUtil::StrToInt(parser.Get('a')) * 1000000LL, 100);
+        book.SetAnalytics(analytics);
+    }
     if(parser.Has('f'))
     {
         BuildOrderBookFromFile(book, parser.Get('f'));
@@ -220,6 +227,13 @@ int main(int argc, char* argv[])
     int size = (parser.Has('s') ? parser.GetInt('s') : 0);
     ReadFromStdin(book, size);
 
+    if(analytics)
+    {
+        analytics->Print();
+        book.SetAnalytics(NULL);
+        delete analytics;
+    }
+
     LOG_DEBUG("clearing orderbook");
     book.Clear();
     book.Print();
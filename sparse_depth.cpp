@@ -0,0 +1,531 @@
+//
+// MapDepth & HybridDepth, see sparse_depth.h
+//
+#include <assert.h>
+#include <string.h>
+
+#include "comm/util/logutil.h"
+
+#include "sparse_depth.h"
+
+extern const char* order_type_desc[];
+
+MapDepth::MapDepth(int type,
+                   int tick_price,
+                   OrderIdLessFunc order_id_less_func,
+                   const AllocPolicy& policy
+    ) : Depth(type, tick_price, order_id_less_func, policy), level_pool_(policy),
+    levels_(less<int32_t>(), PriceLevelAllocator(&level_pool_))
+{
+
+}
+
+MapDepth::~MapDepth()
+{
+    for(auto& level : levels_)
+    {
+        ClearLinkList(level.second.head_);
+    }
+}
+
+void MapDepth::Match(OrderNode &order_node, int32_t* low_price, int32_t* high_price, int32_t cross_price)
+{
+    int idx = 0;
+    auto iter = levels_.begin();
+    while((iter != levels_.end()) && (order_node.size_ > 0))
+    {
+        PriceLevel& level = iter->second;
+        if(!IsCrossed(level.price_, order_node.price_))
+        {
+            break;
+        }
+
+        if(low_price && high_price)
+        {
+            if(*low_price == 0 || level.price_ < *low_price)   *low_price  = level.price_;
+            if(*high_price == 0 || level.price_ > *high_price) *high_price = level.price_;
+        }
+
+        MatchLevel(level.head_, level.size_, order_node, cross_price, idx++);
+        iter = (level.head_ == NULL ? levels_.erase(iter) : iter);
+    }
+
+    LOG_BOOK_TRACE("break consume on levels:%zu, idx:%d", levels_.size(), idx);
+}
+
+void MapDepth::PopCrossed(int32_t price, vector<OrderNode>& order_nodes)
+{
+    int idx = 0;
+    auto iter = levels_.begin();
+    while((iter != levels_.end()) && IsCrossed(iter->second.price_, price))
+    {
+        PopLevel(iter->second.head_, iter->second.size_, order_nodes, idx++);
+        iter = levels_.erase(iter);
+    }
+}
+
+void MapDepth::Print()
+{
+    printf("%s order with levels:%zu\n", order_type_desc[type_], levels_.size());
+
+    int idx = 0;
+    for(auto& level : levels_)
+    {
+        PrintLevel(level.second.head_, idx++);
+    }
+}
+
+void MapDepth::Add(OrderNode &order_node)
+{
+    auto ret = levels_.insert(make_pair(LevelKey(order_node.price_), PriceLevel()));
+    PriceLevel& level = ret.first->second;
+    level.price_ = order_node.price_;
+
+    // idx of a sparse level is its tick offset from top
+    int idx = abs(order_node.price_ - levels_.begin()->second.price_) / tick_price_;
+    AddLinkNode(level.head_, level.size_, order_node, idx);
+
+    if(level.head_ == NULL) // new level while order node is ignored
+    {
+        levels_.erase(ret.first);
+    }
+}
+
+void MapDepth::Clear()
+{
+    for(auto& level : levels_)
+    {
+        ClearLinkList(level.second.head_);
+    }
+
+    levels_.clear();
+    map_link_nodes_.clear();
+}
+
+void MapDepth::DeleteOrder(OrderNode &order_node)
+{
+    auto iter = map_link_nodes_.find(order_node.id_);
+    if(iter == map_link_nodes_.end())
+    {
+        LOG_BOOK_TRACE("missing %s with order id:%s", order_type_desc[type_], order_node.id_.c_str());
+        return;
+    }
+
+    int32_t price = iter->second->value_.price_;
+    auto level_iter = levels_.find(LevelKey(price));
+    assert(level_iter != levels_.end());
+    LOG_BOOK_TRACE("clear %s order node at price:%d", order_type_desc[type_], price);
+
+    RemoveOrder(level_iter->second.head_, level_iter->second.size_, iter);
+    if(level_iter->second.head_ == NULL)
+    {
+        levels_.erase(level_iter);
+    }
+}
+
+bool MapDepth::GetTopPrice(int32_t &price)
+{
+    if(levels_.empty()) { return false; }
+
+    price = levels_.begin()->second.price_;
+    return true;
+}
+
+void MapDepth::CopyLevelSizes(int count, int64_t* sizes)
+{
+    memset(sizes, 0, sizeof(int64_t) * count);
+    if(levels_.empty()) { return; }
+
+    int32_t top_price = levels_.begin()->second.price_;
+    for(auto& level : levels_)
+    {
+        int64_t offset = (int64_t)abs(level.second.price_ - top_price) / tick_price_;
+        if(offset >= count) { break; }
+        sizes[offset] = level.second.size_;
+    }
+}
+
+void MapDepth::CopyLevels(int32_t price, vector<LevelSize>& levels)
+{
+    for(auto& level : levels_)
+    {
+        if(!IsCrossed(level.second.price_, price)) { break; }
+
+        levels.push_back(LevelSize(level.second.price_, level.second.size_));
+    }
+}
+
+void MapDepth::ResetTickPrice(int32_t price)
+{
+    //
+    // levels are keyed by price, so no level moves with smaller tick
+    //
+    if(levels_.empty() || price < tick_price_)
+    {
+        LOG_BOOK_TRACE("reset %s tick price from %d to %d", order_type_desc[type_], tick_price_, price);
+        tick_price_ = price;
+    }
+}
+
+HybridDepth::HybridDepth(int window_size,
+                         int type,
+                         int tick_price,
+                         OrderIdLessFunc order_id_less_func,
+                         const AllocPolicy& policy
+    ) : Depth(type, tick_price, order_id_less_func, policy),
+    window_size_(window_size), headroom_(window_size / 4), level_pool_(policy),
+    overflow_(less<int32_t>(), PriceLevelAllocator(&level_pool_))
+{
+    assert(window_size_ > 0);
+
+    // regions from PolicyAlloc are zeroed, i.e. all NULL
+    slots_      = (LinkNode<OrderNode>**)PolicyAlloc(sizeof(LinkNode<OrderNode>*) * window_size_, policy_);
+    slot_sizes_ = (int64_t*)PolicyAlloc(sizeof(int64_t) * window_size_, policy_);
+}
+
+HybridDepth::~HybridDepth()
+{
+    for(int i = 0; i < window_size_; i++)
+    {
+        if(slots_[i] != NULL)
+        {
+            ClearLinkList(slots_[i]);
+        }
+    }
+
+    for(auto& level : overflow_)
+    {
+        ClearLinkList(level.second.head_);
+    }
+
+    PolicyFree(slots_);
+    PolicyFree(slot_sizes_);
+}
+
+void HybridDepth::Match(OrderNode &order_node, int32_t* low_price, int32_t* high_price, int32_t cross_price)
+{
+    while((top_ != -1) && (order_node.size_ > 0))
+    {
+        int32_t price = slots_[top_]->value_.price_;
+        if(!IsCrossed(price, order_node.price_))
+        {
+            break;
+        }
+
+        if(low_price && high_price)
+        {
+            if(*low_price == 0 || price < *low_price)   *low_price  = price;
+            if(*high_price == 0 || price > *high_price) *high_price = price;
+        }
+
+        MatchLevel(slots_[top_], slot_sizes_[top_], order_node, cross_price, top_);
+        if(slots_[top_] == NULL)
+        {
+            ResetTop();
+        }
+    }
+
+    LOG_BOOK_TRACE("break consume on top:%d, base:%d", top_, base_price_);
+}
+
+void HybridDepth::PopCrossed(int32_t price, vector<OrderNode>& order_nodes)
+{
+    while((top_ != -1) && IsCrossed(slots_[top_]->value_.price_, price))
+    {
+        PopLevel(slots_[top_], slot_sizes_[top_], order_nodes, top_);
+        ResetTop();
+    }
+}
+
+void HybridDepth::Print()
+{
+    printf("%s order with top:%d, base:%d, window_size:%d, overflow:%zu\n",
+           order_type_desc[type_], top_, base_price_, window_size_, overflow_.size());
+    if(top_ == -1)
+    {
+        return;
+    }
+
+    for(int idx = top_; idx < window_size_; idx++)
+    {
+        if(slots_[idx] == NULL) { continue; }
+        PrintLevel(slots_[idx], idx);
+    }
+
+    for(auto& level : overflow_)
+    {
+        PrintLevel(level.second.head_, (int)GetOffset(level.second.price_));
+    }
+}
+
+void HybridDepth::Add(OrderNode &order_node)
+{
+    if(top_ == -1)  // overflow_ is empty too
+    {
+        base_price_ = GetBaseFor(order_node.price_);
+    }
+
+    int64_t offset = GetOffset(order_node.price_);
+    if(offset < 0)
+    {
+        Rebase(GetBaseFor(order_node.price_));
+        offset = GetOffset(order_node.price_);
+    }
+
+    if(offset >= window_size_)
+    {
+        auto ret = overflow_.insert(make_pair(LevelKey(order_node.price_), PriceLevel()));
+        PriceLevel& level = ret.first->second;
+        level.price_ = order_node.price_;
+        AddLinkNode(level.head_, level.size_, order_node, (int)offset);
+        if(level.head_ == NULL) // new level while order node is ignored
+        {
+            overflow_.erase(ret.first);
+        }
+        return;
+    }
+
+    int idx = (int)offset;
+    AddLinkNode(slots_[idx], slot_sizes_[idx], order_node, idx);
+    if((slots_[idx] != NULL) && (top_ == -1 || idx < top_))
+    {
+        top_ = idx;
+    }
+}
+
+void HybridDepth::Clear()
+{
+    for(int i = 0; i < window_size_; i++)
+    {
+        if(slots_[i] != NULL)
+        {
+            ClearLinkList(slots_[i]);
+            slots_[i] = NULL;
+        }
+        slot_sizes_[i] = 0;
+    }
+
+    for(auto& level : overflow_)
+    {
+        ClearLinkList(level.second.head_);
+    }
+
+    overflow_.clear();
+    map_link_nodes_.clear();
+    top_ = -1;
+}
+
+void HybridDepth::DeleteOrder(OrderNode &order_node)
+{
+    auto iter = map_link_nodes_.find(order_node.id_);
+    if(iter == map_link_nodes_.end())
+    {
+        LOG_BOOK_TRACE("missing %s with order id:%s", order_type_desc[type_], order_node.id_.c_str());
+        return;
+    }
+
+    int32_t price  = iter->second->value_.price_;
+    int64_t offset = GetOffset(price);
+    LOG_BOOK_TRACE("clear %s order node at offset:%ld", order_type_desc[type_], (long)offset);
+
+    if(offset < window_size_)
+    {
+        int idx = (int)offset;
+        RemoveOrder(slots_[idx], slot_sizes_[idx], iter);
+        if(idx == top_ && slots_[idx] == NULL)
+        {
+            ResetTop();
+        }
+        return;
+    }
+
+    auto level_iter = overflow_.find(LevelKey(price));
+    assert(level_iter != overflow_.end());
+    RemoveOrder(level_iter->second.head_, level_iter->second.size_, iter);
+    if(level_iter->second.head_ == NULL)
+    {
+        overflow_.erase(level_iter);
+    }
+}
+
+bool HybridDepth::GetTopPrice(int32_t &price)
+{
+    if(top_ == -1) { return false; }
+
+    price = slots_[top_]->value_.price_;
+    return true;
+}
+
+void HybridDepth::CopyLevelSizes(int count, int64_t* sizes)
+{
+    if(top_ == -1)
+    {
+        memset(sizes, 0, sizeof(int64_t) * count);
+        return;
+    }
+
+    int copy_size = std::min(count, window_size_ - top_);
+    memcpy(sizes, slot_sizes_ + top_, sizeof(int64_t) * copy_size);
+    memset(sizes + copy_size, 0, sizeof(int64_t) * (count - copy_size));
+
+    for(auto& level : overflow_)
+    {
+        int64_t offset = GetOffset(level.second.price_) - top_;
+        if(offset >= count) { break; }
+        sizes[offset] = level.second.size_;
+    }
+}
+
+void HybridDepth::CopyLevels(int32_t price, vector<LevelSize>& levels)
+{
+    if(top_ == -1) { return; }
+
+    for(int idx = top_; idx < window_size_; idx++)
+    {
+        if(slots_[idx] == NULL) { continue; }
+        if(!IsCrossed(slots_[idx]->value_.price_, price)) { return; }
+
+        levels.push_back(LevelSize(slots_[idx]->value_.price_, slot_sizes_[idx]));
+    }
+
+    for(auto& level : overflow_)
+    {
+        if(!IsCrossed(level.second.price_, price)) { break; }
+
+        levels.push_back(LevelSize(level.second.price_, level.second.size_));
+    }
+}
+
+void HybridDepth::ResetTickPrice(int32_t price)
+{
+    if(top_ == -1)  // it's safe to change tick price if current no OrderNode
+    {
+        tick_price_ = price;
+        return;
+    }
+
+    if(tick_price_ <= price) { return; }
+
+    //
+    // spill whole window and lay it out again on new tick
+    //
+    int32_t top_price = slots_[top_]->value_.price_;
+    for(int i = top_; i < window_size_; i++)
+    {
+        if(slots_[i] != NULL) { MoveToOverflow(i); }
+    }
+
+    LOG_BOOK_TRACE("reset %s with overflow:%zu when reset tick price from %d to %d",
+                order_type_desc[type_], overflow_.size(), tick_price_, price);
+    tick_price_ = price;
+    base_price_ = GetBaseFor(top_price);
+    top_        = -1;
+    PullOverflow();
+}
+
+int64_t HybridDepth::GetOffset(int32_t price)
+{
+    int64_t diff = ((int64_t)price - base_price_) * (type_ == OrderType_Ask ? 1 : -1);
+    return (diff >= 0 ? diff / tick_price_ : -((-diff + tick_price_ - 1) / tick_price_));
+}
+
+int32_t HybridDepth::GetBaseFor(int32_t best_price)
+{
+    int64_t headroom_price = (int64_t)headroom_ * tick_price_;
+    return (int32_t)(type_ == OrderType_Ask ? best_price - headroom_price : best_price + headroom_price);
+}
+
+void HybridDepth::MoveToOverflow(int offset)
+{
+    PriceLevel& level = overflow_[LevelKey(slots_[offset]->value_.price_)];
+    level.price_ = slots_[offset]->value_.price_;
+    level.head_  = slots_[offset];
+    level.size_  = slot_sizes_[offset];
+    slots_[offset]      = NULL;
+    slot_sizes_[offset] = 0;
+}
+
+void HybridDepth::PullOverflow()
+{
+    while(!overflow_.empty())
+    {
+        auto iter = overflow_.begin();
+        int64_t offset = GetOffset(iter->second.price_);
+        if(offset >= window_size_) { break; }
+
+        assert(offset >= 0 && slots_[offset] == NULL);
+        slots_[offset]      = iter->second.head_;
+        slot_sizes_[offset] = iter->second.size_;
+        overflow_.erase(iter);
+        if(top_ == -1 || offset < top_)
+        {
+            top_ = (int)offset;
+        }
+    }
+}
+
+void HybridDepth::Rebase(int32_t base_price)
+{
+    int64_t delta = GetOffset(base_price);
+    if(delta == 0) { return; }
+
+    LOG_BOOK_TRACE("rebase %s window from %d to %d with top:%d",
+                order_type_desc[type_], base_price_, base_price, top_);
+    if(delta > 0)   // window moves to worse prices, slots before delta are empty
+    {
+        assert(top_ == -1 || top_ >= delta);
+        if(delta < window_size_)
+        {
+            int keep = window_size_ - (int)delta;
+            memmove(slots_, slots_ + delta, sizeof(LinkNode<OrderNode>*) * keep);
+            memmove(slot_sizes_, slot_sizes_ + delta, sizeof(int64_t) * keep);
+            memset(slots_ + keep, 0, sizeof(LinkNode<OrderNode>*) * delta);
+            memset(slot_sizes_ + keep, 0, sizeof(int64_t) * delta);
+        }
+        top_ = (top_ == -1 ? -1 : top_ - (int)delta);
+        base_price_ = base_price;
+        PullOverflow();
+        return;
+    }
+
+    // window moves to better prices, levels beyond window spill into overflow_
+    int64_t shift = -delta;
+    for(int64_t i = std::max((int64_t)0, window_size_ - shift); i < window_size_; i++)
+    {
+        if(slots_[i] != NULL) { MoveToOverflow((int)i); }
+    }
+
+    if(shift < window_size_)
+    {
+        int keep = window_size_ - (int)shift;
+        memmove(slots_ + shift, slots_, sizeof(LinkNode<OrderNode>*) * keep);
+        memmove(slot_sizes_ + shift, slot_sizes_, sizeof(int64_t) * keep);
+        memset(slots_, 0, sizeof(LinkNode<OrderNode>*) * shift);
+        memset(slot_sizes_, 0, sizeof(int64_t) * shift);
+    }
+
+    top_ = ((top_ == -1 || top_ + shift >= window_size_) ? -1 : top_ + (int)shift);
+    base_price_ = base_price;
+}
+
+void HybridDepth::ResetTop()
+{
+    if(top_ != -1)
+    {
+        while((top_ < window_size_) && (slots_[top_] == NULL)) { top_++; }
+        if(top_ == window_size_) { top_ = -1; }
+    }
+
+    if(top_ == -1)
+    {
+        if(!overflow_.empty())  // window is empty, recenter it on best overflow level
+        {
+            base_price_ = GetBaseFor(overflow_.begin()->second.price_);
+            PullOverflow();
+        }
+    }
+    else if(top_ > window_size_ / 2)    // keep headroom for better orders
+    {
+        Rebase(GetBaseFor(slots_[top_]->value_.price_));
+    }
+}
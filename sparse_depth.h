@@ -0,0 +1,140 @@
+//
+// Depth implementations for sparse & wide price ranges, see LevelContainer.
+// MapDepth keeps only non-empty price levels in an ordered map. HybridDepth
+// keeps a dense array window of ticks near top like ArrayDepth and spills
+// levels beyond the window into an ordered map.
+//
+#pragma once
+
+#include <map>
+using namespace std;
+
+#include "orderbook.h"
+
+typedef struct PriceLevel
+{
+    int32_t              price_ = 0;
+    int64_t              size_  = 0;    // total size of order nodes
+    LinkNode<OrderNode>* head_  = NULL;
+} PriceLevel;
+
+// keyed by Depth::LevelKey, best level first
+typedef PoolAllocator<pair<const int32_t, PriceLevel> > PriceLevelAllocator;
+typedef map<int32_t, PriceLevel, less<int32_t>, PriceLevelAllocator> PriceLevelMap;
+
+class MapDepth : public Depth
+{
+public:
+    MapDepth(int type,
+             int tick_price,
+             OrderIdLessFunc order_id_less_func,
+             const AllocPolicy& policy = AllocPolicy()
+    );
+
+    virtual ~MapDepth();
+
+    virtual void Match(OrderNode& order_node, int32_t* low_price = NULL, int32_t* high_price = NULL,
+                       int32_t cross_price = 0);
+
+    virtual void PopCrossed(int32_t price, vector<OrderNode>& order_nodes);
+
+    virtual void Print();
+
+    virtual void Add(OrderNode& order_node);
+
+    virtual void Clear();
+
+    virtual void DeleteOrder(OrderNode &order_node);
+
+    virtual bool GetTopPrice(int32_t& price);
+
+    virtual void CopyLevelSizes(int count, int64_t* sizes);
+
+    virtual void CopyLevels(int32_t price, vector<LevelSize>& levels);
+
+    virtual void ResetTickPrice(int32_t price);
+
+private:
+    PolicyPool    level_pool_;  // storage of levels_
+    PriceLevelMap levels_;
+};
+
+class HybridDepth : public Depth
+{
+public:
+    /*
+     * window_size: ticks kept in dense array since window base
+     */
+    HybridDepth(int window_size,
+                int type,
+                int tick_price,
+                OrderIdLessFunc order_id_less_func,
+                const AllocPolicy& policy = AllocPolicy()
+    );
+
+    virtual ~HybridDepth();
+
+    virtual void Match(OrderNode& order_node, int32_t* low_price = NULL, int32_t* high_price = NULL,
+                       int32_t cross_price = 0);
+
+    virtual void PopCrossed(int32_t price, vector<OrderNode>& order_nodes);
+
+    virtual void Print();
+
+    virtual void Add(OrderNode& order_node);
+
+    virtual void Clear();
+
+    virtual void DeleteOrder(OrderNode &order_node);
+
+    virtual bool GetTopPrice(int32_t& price);
+
+    virtual void CopyLevelSizes(int count, int64_t* sizes);
+
+    virtual void CopyLevels(int32_t price, vector<LevelSize>& levels);
+
+    virtual void ResetTickPrice(int32_t price);
+
+private:
+    /*
+     * tick offset of price since base_price_ in priority direction,
+     * negative if better than base
+     */
+    int64_t GetOffset(int32_t price);
+
+    /*
+     * base price leaving headroom_ ticks before best_price for better orders
+     */
+    int32_t GetBaseFor(int32_t best_price);
+
+    /*
+     * move price level at window offset into overflow_
+     */
+    void MoveToOverflow(int offset);
+
+    /*
+     * move overflow levels falling into window back into slots
+     */
+    void PullOverflow();
+
+    /*
+     * shift window to new base price. Levels leaving window go to overflow_
+     */
+    void Rebase(int32_t base_price);
+
+    /*
+     * search next non-empty slot since top_. Recenter window on overflow
+     * when window runs empty, or shift it when top_ drifts past half window
+     */
+    void ResetTop();
+
+    int     window_size_;
+    int     headroom_;
+    int32_t base_price_ = 0;    // price at slot 0
+    int     top_        = -1;   // slot of best level, -1 if depth is empty
+
+    LinkNode<OrderNode>** slots_;
+    int64_t*              slot_sizes_;  // total size of each slot
+    PolicyPool            level_pool_;  // storage of overflow_
+    PriceLevelMap         overflow_;    // levels beyond window, never empty if window is
+};
@@ -0,0 +1,145 @@
+//
+// streaming trade analytics, see trade_analytics.h
+//
+#include <stdio.h>
+#include <time.h>
+
+#include "trade_analytics.h"
+
+int64_t RealtimeNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+TradeAnalytics::TradeAnalytics(int64_t bar_interval_ns, int bar_capacity, ClockFunc clock_func)
+    : bar_interval_(bar_interval_ns > 0 ? bar_interval_ns : 1), clock_func_(clock_func),
+    bars_(bar_capacity > 0 ? bar_capacity : 1)
+{
+
+}
+
+void TradeAnalytics::OnTrade(int32_t price, int32_t size)
+{
+    int64_t now   = clock_func_();
+    int64_t start = now - now % bar_interval_;
+
+    volume_     += size;
+    turnover_   += (int64_t)price * size;
+    trades_     += 1;
+    last_price_  = price;
+
+    //
+    // open new bar on interval change, intervals without trade have no bar.
+    // Trades with earlier time, e.g. on clock adjustment, go to latest bar
+    //
+    int capacity = (int)bars_.size();
+    if(bar_count_ == 0 || start > bars_[bar_head_].start_time_)
+    {
+        bar_head_  = (bar_count_ == 0 ? 0 : (bar_head_ + 1) % capacity);
+        bar_count_ = (bar_count_ < capacity ? bar_count_ + 1 : capacity);
+
+        OhlcvBar& bar = bars_[bar_head_];
+        bar = OhlcvBar();
+        bar.start_time_ = start;
+        bar.open_ = bar.high_ = bar.low_ = price;
+    }
+
+    OhlcvBar& bar = bars_[bar_head_];
+    if(price > bar.high_) { bar.high_ = price; }
+    if(price < bar.low_)  { bar.low_  = price; }
+    bar.close_     = price;
+    bar.volume_   += size;
+    bar.turnover_ += (int64_t)price * size;
+    bar.trades_   += 1;
+}
+
+void TradeAnalytics::OnQuote(int32_t bid_price, int32_t ask_price)
+{
+    int64_t now = clock_func_();
+    UpdateTimeWeighted(twa_bid_, bid_price != 0, bid_price, now);
+    UpdateTimeWeighted(twa_ask_, ask_price != 0, ask_price, now);
+    UpdateTimeWeighted(twa_spread_, bid_price != 0 && ask_price != 0, (double)ask_price - bid_price, now);
+}
+
+double TradeAnalytics::GetVwap()
+{
+    return (volume_ == 0 ? 0 : (double)turnover_ / volume_);
+}
+
+const OhlcvBar& TradeAnalytics::GetBar(int back)
+{
+    int capacity = (int)bars_.size();
+    return bars_[(bar_head_ - back % capacity + capacity) % capacity];
+}
+
+double TradeAnalytics::GetTwaBid()
+{
+    return GetTimeWeighted(twa_bid_, clock_func_());
+}
+
+double TradeAnalytics::GetTwaAsk()
+{
+    return GetTimeWeighted(twa_ask_, clock_func_());
+}
+
+double TradeAnalytics::GetTwaSpread()
+{
+    return GetTimeWeighted(twa_spread_, clock_func_());
+}
+
+void TradeAnalytics::Print()
+{
+    printf("trades:%lld volume:%lld vwap:%.4f last:%d twa bid:%.4f ask:%.4f spread:%.4f\n",
+           (long long)trades_, (long long)volume_, GetVwap(), last_price_,
+           GetTwaBid(), GetTwaAsk(), GetTwaSpread());
+    for(int i = bar_count_ - 1; i >= 0; i--)
+    {
+        const OhlcvBar& bar = GetBar(i);
+        printf("bar %lld: open:%d high:%d low:%d close:%d volume:%lld vwap:%.4f trades:%d\n",
+               (long long)bar.start_time_, bar.open_, bar.high_, bar.low_, bar.close_,
+               (long long)bar.volume_, (double)bar.turnover_ / bar.volume_, bar.trades_);
+    }
+}
+
+void TradeAnalytics::Reset()
+{
+    bar_head_   = bar_count_ = 0;
+    volume_     = turnover_ = trades_ = 0;
+    last_price_ = 0;
+    twa_bid_    = TimeWeighted();
+    twa_ask_    = TimeWeighted();
+    twa_spread_ = TimeWeighted();
+}
+
+void TradeAnalytics::UpdateTimeWeighted(TimeWeighted &tw, bool valid, double value, int64_t now)
+{
+    if(tw.valid_ && now > tw.since_)
+    {
+        tw.sum_      += tw.value_ * (now - tw.since_);
+        tw.duration_ += now - tw.since_;
+    }
+
+    tw.valid_ = valid;
+    tw.value_ = value;
+    tw.since_ = now;
+}
+
+double TradeAnalytics::GetTimeWeighted(const TimeWeighted &tw, int64_t now)
+{
+    double  sum      = tw.sum_;
+    int64_t duration = tw.duration_;
+    if(tw.valid_ && now > tw.since_)
+    {
+        sum      += tw.value_ * (now - tw.since_);
+        duration += now - tw.since_;
+    }
+
+    if(duration == 0)
+    {
+        // present for no measurable time yet, fall back to current value
+        return (tw.valid_ ? tw.value_ : 0);
+    }
+    return sum / duration;
+}
@@ -0,0 +1,121 @@
+//
+// Streaming trade analytics fed by the match loop: session VWAP, volume and
+// trade count, OHLCV bars per fixed interval, and time weighted averages of
+// best prices & spread. Memory is fixed at construction, every update and
+// query is O(1).
+//
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+typedef int64_t (*ClockFunc)();
+
+/*
+ * nanoseconds since epoch of CLOCK_REALTIME
+ */
+int64_t RealtimeNanos();
+
+typedef struct OhlcvBar
+{
+    int64_t start_time_ = 0;    // nanoseconds, aligned to bar interval
+    int32_t open_       = 0;
+    int32_t high_       = 0;
+    int32_t low_        = 0;
+    int32_t close_      = 0;
+    int64_t volume_     = 0;
+    int64_t turnover_   = 0;    // sum of price * size
+    int32_t trades_     = 0;
+} OhlcvBar;
+
+class TradeAnalytics
+{
+public:
+    /*
+     * bar_interval_ns: length of each OHLCV bar
+     * bar_capacity   : number of latest bars kept, older bars are overwritten
+     * clock_func     : time source, replace it for replay
+     */
+    TradeAnalytics(int64_t bar_interval_ns,
+                   int bar_capacity,
+                   ClockFunc clock_func = RealtimeNanos
+    );
+
+    /*
+     * one fill of size at price
+     */
+    void OnTrade(int32_t price, int32_t size);
+
+    /*
+     * best prices after book change, 0 if that side is empty
+     */
+    void OnQuote(int32_t bid_price, int32_t ask_price);
+
+    double  GetVwap();
+
+    int64_t GetVolume() { return volume_; }
+
+    int64_t GetTradeCount() { return trades_; }
+
+    int32_t GetLastPrice() { return last_price_; }
+
+    /*
+     * number of bars kept, at most bar_capacity
+     */
+    int GetBarCount() { return bar_count_; }
+
+    /*
+     * bar by recency, 0 for the latest one. back must be less than GetBarCount
+     */
+    const OhlcvBar& GetBar(int back);
+
+    /*
+     * time weighted averages until now, counting only the time that side
+     * (both sides for spread) was present. 0 if never present
+     */
+    double GetTwaBid();
+
+    double GetTwaAsk();
+
+    double GetTwaSpread();
+
+    /*
+     * print session statistics and latest bars
+     */
+    void Print();
+
+    void Reset();
+
+private:
+    //
+    // time weighted average of a value which may be absent
+    //
+    typedef struct TimeWeighted
+    {
+        double  sum_      = 0;  // value * duration of past periods
+        int64_t duration_ = 0;
+        double  value_    = 0;
+        bool    valid_    = false;
+        int64_t since_    = 0;
+    } TimeWeighted;
+
+    static void UpdateTimeWeighted(TimeWeighted& tw, bool valid, double value, int64_t now);
+
+    static double GetTimeWeighted(const TimeWeighted& tw, int64_t now);
+
+    int64_t          bar_interval_;
+    ClockFunc        clock_func_;
+    vector<OhlcvBar> bars_;
+    int              bar_head_   = 0;   // index of latest bar in bars_
+    int              bar_count_  = 0;
+
+    int64_t          volume_     = 0;
+    int64_t          turnover_   = 0;
+    int64_t          trades_     = 0;
+    int32_t          last_price_ = 0;
+
+    TimeWeighted     twa_bid_;
+    TimeWeighted     twa_ask_;
+    TimeWeighted     twa_spread_;
+};